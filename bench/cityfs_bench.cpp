@@ -0,0 +1,722 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+//
+// Micro-benchmarks for the cityfs data paths.
+//
+//   $ cityfs_bench load cities15k.csv [repeat] [threads]
+//   $ cityfs_bench snapshot cities15k.csv cities15k.cfsdb
+//   $ cityfs_bench memory cities15k.csv
+//   $ cityfs_bench country-lookup cities15k.csv
+//   $ cityfs_bench scan cities15k.csv [repeat] [csv|geonames]
+//   $ cityfs_bench numbers cities15k.csv [repeat] [csv|geonames]
+//   $ cityfs_bench misses cities15k.csv [repeat]
+//   $ cityfs_bench paths cities15k.csv [repeat]
+//   $ cityfs_bench intern cities15k.csv [repeat] [csv|geonames]
+
+#include "src/cityfs.hpp"
+#include "src/cityfs_flat.hpp"
+#include "src/cityfs_radix.hpp"
+#include "src/cityfs_store.hpp"
+#include "src/mapped_file.hpp"
+#include <charconv>
+#include <chrono>
+#include <clocale>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <malloc.h>
+#include <map>
+
+using namespace std;
+using namespace cityfs;
+
+namespace {
+
+  double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  }
+
+  // The original all-string city model, kept as the baseline.
+  struct LegacyCity {
+    string name;
+    string latitude;
+    string longitude;
+    string population;
+    string timezone;
+  };
+
+  struct LegacyCountry {
+    string name;
+    vector<string> city_names;
+    unordered_map<string, LegacyCity> city_map;
+  };
+
+  typedef unordered_map<string, LegacyCountry> LegacyCountryMap;
+
+  // The original ifstream + getline loader, kept as the baseline.
+  bool parse_cities_stream(const string& path, LegacyCountryMap& countries) {
+    ifstream ifs;
+    ifs.open(path);
+    if (!ifs.is_open()) {
+      return false;
+    }
+    string line;
+    while(getline(ifs, line)) {
+      LegacyCity next;
+      string country_code;
+      istringstream iss(line);
+
+      getline(iss, country_code, ',');
+      getline(iss, next.name, ',');
+      getline(iss, next.latitude, ',');
+      getline(iss, next.longitude, ',');
+      getline(iss, next.population, ',');
+      getline(iss, next.timezone, ',');
+
+      countries[country_code].city_map.insert(make_pair(next.name, next));
+      countries[country_code].name = country_code;
+    }
+    return true;
+  }
+
+  template <typename Countries>
+  size_t city_count(const Countries& countries) {
+    size_t count = 0;
+    for (auto& country_pair : countries) {
+      count += country_pair.second.city_map.size();
+    }
+    return count;
+  }
+
+  int bench_load(const vector<string>& args) {
+    if (args.empty()) {
+      cerr << "load [city-file] [repeat] [threads]\n";
+      return 1;
+    }
+    auto& path = args[0];
+    int repeat = args.size() > 1 ? stoi(args[1]) : 5;
+    unsigned threads = args.size() > 2 ? stoul(args[2]) : 0;
+
+    double stream_best = 0.0;
+    size_t stream_rows = 0;
+    for (int i = 0; i < repeat; ++i) {
+      LegacyCountryMap countries;
+      auto start = chrono::steady_clock::now();
+      if (!parse_cities_stream(path, countries)) {
+        cerr << "Error reading " << path << endl;
+        return 1;
+      }
+      auto elapsed = seconds_since(start);
+      stream_best = i == 0 ? elapsed : min(stream_best, elapsed);
+      stream_rows = city_count(countries);
+    }
+
+    auto best_load = [&](unsigned threads) {
+      LoadOptions options;
+      options.threads = threads;
+      LoadStats best;
+      for (int i = 0; i < repeat; ++i) {
+        CityStore city_store;
+        LoadStats stats;
+        if (!parse_cities(path, city_store, options, &stats)) break;
+        if (i == 0 || stats.seconds < best.seconds) best = stats;
+      }
+      return best;
+    };
+    auto mapped = best_load(1);
+    auto parallel = best_load(threads);
+
+    cout << "stream:   " << stream_rows << " cities in "
+      << stream_best * 1000.0 << "ms ("
+      << static_cast<size_t>(stream_rows / stream_best) << " rows/sec)\n";
+    cout << "mmap:     " << mapped << "\n";
+    cout << "parallel: " << parallel << "\n";
+    cout << "speedup: " << stream_best / mapped.seconds << "x mmap, "
+      << stream_best / parallel.seconds << "x parallel\n";
+    return 0;
+  }
+
+  // Startup cost of parsing + building the db against mapping a snapshot.
+  int bench_snapshot(const vector<string>& args) {
+    if (args.size() < 2) {
+      cerr << "snapshot [city-file] [snapshot-file]\n";
+      return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    CityStore built;
+    if (!parse_cities(args[0], built, LoadOptions())) return 1;
+    auto build_seconds = seconds_since(start);
+    if (!built.save(args[1])) return 1;
+
+    start = chrono::steady_clock::now();
+    CityStore mapped;
+    if (!mapped.load(args[1])) return 1;
+    auto load_seconds = seconds_since(start);
+
+    cout << "parse + build: " << built.city_count() << " cities in "
+      << build_seconds * 1000.0 << "ms\n";
+    cout << "snapshot load: " << mapped.city_count() << " cities in "
+      << load_seconds * 1000.0 << "ms\n";
+    return 0;
+  }
+
+  size_t heap_in_use() {
+    return mallinfo2().uordblks;
+  }
+
+  // Resident heap of the original string model against the store.
+  int bench_memory(const vector<string>& args) {
+    if (args.empty()) {
+      cerr << "memory [city-file]\n";
+      return 1;
+    }
+    auto& path = args[0];
+
+    size_t legacy_cities = 0;
+    auto before = heap_in_use();
+    LegacyCountryMap legacy;
+    if (!parse_cities_stream(path, legacy)) return 1;
+    for (auto& country_pair : legacy) {
+      auto& country = country_pair.second;
+      for (auto& city_pair : country.city_map) {
+        country.city_names.push_back(city_pair.first);
+      }
+    }
+    legacy_cities = city_count(legacy);
+    auto legacy_bytes = heap_in_use() - before;
+    legacy.clear();
+
+    before = heap_in_use();
+    CityStore city_store;
+    if (!parse_cities(path, city_store, LoadOptions())) return 1;
+    auto store_bytes = heap_in_use() - before;
+
+    cout << "legacy:  " << legacy_cities << " cities, " 
+      << legacy_bytes << " bytes ("
+      << legacy_bytes / max<size_t>(legacy_cities, 1) << " bytes/city)\n";
+    cout << "store:   " << city_store.city_count() << " cities, " 
+      << store_bytes << " bytes ("
+      << store_bytes / max<size_t>(city_store.city_count(), 1) << " bytes/city, "
+      << city_store.timezone_count() << " timezones)\n";
+    cout << "saving:  " << static_cast<double>(legacy_bytes) / max<size_t>(store_bytes, 1) 
+      << "x\n";
+    return 0;
+  }
+
+  // path_to_country over the original runtime-built unordered_maps 
+  // against the compile-time table.
+  int bench_country_lookup(const vector<string>& args) {
+    if (args.empty()) {
+      cerr << "country-lookup [city-file] [repeat]\n";
+      return 1;
+    }
+    int repeat = args.size() > 1 ? stoi(args[1]) : 1000;
+
+    CityStore city_store;
+    if (!parse_cities(args[0], city_store, LoadOptions())) return 1;
+
+    unordered_map<string, string> legacy_codes, legacy_countries;
+    vector<string> names;
+    for (size_t i = 0; i < city_store.country_count(); ++i) {
+      auto code = string(city_store.country_code(i));
+      auto name = string(country_to_path(code));
+      legacy_codes.insert({code, name});
+      legacy_countries.insert({name, code});
+      names.push_back(name);
+    }
+    names.push_back(".DS_Store");
+
+    auto legacy_path_to_country = [&](const string& country) -> string {
+      auto iter = legacy_countries.find(country);
+      if (iter != legacy_countries.end()) {
+        return iter->second;
+      }
+      return country;
+    };
+
+    size_t checksum = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < repeat; ++i) {
+      for (auto& name : names) {
+        checksum += legacy_path_to_country(name).size();
+      }
+    }
+    auto legacy_seconds = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < repeat; ++i) {
+      for (auto& name : names) {
+        checksum += path_to_country(name).size();
+      }
+    }
+    auto table_seconds = seconds_since(start);
+
+    auto lookups = static_cast<double>(repeat) * names.size();
+    cout << "unordered_map: " << legacy_seconds * 1e9 / lookups << "ns/lookup\n";
+    cout << "table:         " << table_seconds * 1e9 / lookups << "ns/lookup\n";
+    cout << "speedup: " << legacy_seconds / table_seconds << "x (" 
+      << checksum % 10 << ")\n";
+    return 0;
+  }
+
+  // Splitting rows into fields, memchr per field and line (the previous
+  // tokenizer) against the bitmap scan with each block scanner.
+  int bench_scan(const vector<string>& args) {
+    if (args.empty()) {
+      cerr << "scan [city-file] [repeat] [csv|geonames]\n";
+      return 1;
+    }
+    int repeat = args.size() > 1 ? stoi(args[1]) : 10;
+    auto format = args.size() > 2 && args[2] == "geonames" ?
+      CityFormat::geonames() : CityFormat();
+
+    MappedFile file;
+    if (!file.open(args[0])) {
+      cerr << "Error reading " << args[0] << endl;
+      return 1;
+    }
+
+    auto best_of = [&](function<size_t()> scan, size_t& checksum) {
+      double best = 0.0;
+      for (int i = 0; i < repeat; ++i) {
+        auto start = chrono::steady_clock::now();
+        checksum = scan();
+        auto elapsed = seconds_since(start);
+        best = i == 0 ? elapsed : min(best, elapsed);
+      }
+      return best;
+    };
+    auto report = [&](const char* name, double seconds, size_t checksum) {
+      cout << name << ": " << seconds * 1000.0 << "ms, "
+        << file.size() / seconds / (1 << 20) << " MB/s (" << checksum << ")\n";
+    };
+
+    size_t checksum = 0;
+    auto memchr_seconds = best_of([&] {
+        size_t names = 0;
+        auto last_column = *max_element(format.columns, format.columns + CityFormat::Timezone + 1);
+        for_each_line(file.data(), file.end(), [&](string_view line) {
+            auto pos = line.data();
+            auto end = line.data() + line.size();
+            for (unsigned column = 0; column <= last_column; ++column) {
+              auto field = csv::next_field(pos, end, format.delimiter);
+              if (column == format.columns[CityFormat::Name]) names += field.size();
+            }
+          });
+        return names;
+      }, checksum);
+    report("memchr", memchr_seconds, checksum);
+
+    for (auto name : {"scalar", "sse2", "avx2"}) {
+      auto scanner = simd::scanner_named(name);
+      if (scanner == nullptr) {
+        cout << name << ": not supported\n";
+        continue;
+      }
+      RowProjection projection(format);
+      projection.set_scanner(scanner);
+      auto seconds = best_of([&] {
+          size_t names = 0;
+          projection.scan(file.data(), file.end(), [&](const CityRow& row) {
+              names += row.name.size();
+            });
+          return names;
+        }, checksum);
+      report(name, seconds, checksum);
+    }
+    cout << "parse_cities uses " << simd::block_scanner_name() << "\n";
+    return 0;
+  }
+
+  int bench_numbers(const vector<string>& args) {
+    if (args.empty()) {
+      cerr << "numbers [city-file] [repeat] [csv|geonames]\n";
+      return 1;
+    }
+    int repeat = args.size() > 1 ? stoi(args[1]) : 10;
+    auto format = args.size() > 2 && args[2] == "geonames" ?
+      CityFormat::geonames() : CityFormat();
+
+    MappedFile file;
+    if (!file.open(args[0])) {
+      cerr << "Error reading " << args[0] << endl;
+      return 1;
+    }
+
+    // Copied out so strtod has its terminator and every parser sees the
+    // same fields.
+    vector<string> coordinates, populations;
+    RowProjection projection(format);
+    projection.scan(file.data(), file.end(), [&](const CityRow& row) {
+        coordinates.emplace_back(row.latitude);
+        coordinates.emplace_back(row.longitude);
+        populations.emplace_back(row.population);
+      });
+    cout << coordinates.size() << " coordinates, "
+      << populations.size() << " populations\n";
+
+    auto run = [&](const char* name,
+        function<int32_t(const string&)> coordinate,
+        function<uint32_t(const string&)> population) {
+      double best = 0.0;
+      int64_t checksum = 0;
+      for (int i = 0; i < repeat; ++i) {
+        auto start = chrono::steady_clock::now();
+        checksum = 0;
+        for (auto& text : coordinates) checksum += coordinate(text);
+        for (auto& text : populations) checksum += population(text);
+        auto elapsed = seconds_since(start);
+        best = i == 0 ? elapsed : min(best, elapsed);
+      }
+      auto fields = coordinates.size() + populations.size();
+      cout << name << ": " << best * 1000.0 << "ms, "
+        << static_cast<size_t>(fields / best) << " fields/sec ("
+        << checksum << ")\n";
+    };
+
+    setlocale(LC_NUMERIC, "C");
+    run("strtod",
+        [](const string& text) {
+          return static_cast<int32_t>(lround(strtod(text.c_str(), nullptr) * CoordinateScale));
+        },
+        [](const string& text) {
+          return static_cast<uint32_t>(strtoul(text.c_str(), nullptr, 10));
+        });
+    run("istringstream",
+        [](const string& text) {
+          double degrees = 0.0;
+          istringstream(text) >> degrees;
+          return static_cast<int32_t>(lround(degrees * CoordinateScale));
+        },
+        [](const string& text) {
+          uint32_t value = 0;
+          istringstream(text) >> value;
+          return value;
+        });
+    run("from_chars",
+        [](const string& text) {
+          double degrees = 0.0;
+          from_chars(text.data(), text.data() + text.size(), degrees);
+          return static_cast<int32_t>(lround(degrees * CoordinateScale));
+        },
+        [](const string& text) {
+          uint32_t value = 0;
+          from_chars(text.data(), text.data() + text.size(), value);
+          return value;
+        });
+    run("fixed-point",
+        [](const string& text) {
+          int32_t value = 0;
+          parse_coordinate(text, value);
+          return value;
+        },
+        [](const string& text) {
+          uint32_t value = 0;
+          parse_population(text, value);
+          return value;
+        });
+    return 0;
+  }
+
+  // Lookups of names that aren't there, as shells and file managers
+  // probe for, with and without the store's name filter in front.
+  int bench_misses(const vector<string>& args) {
+    if (args.empty()) {
+      cerr << "misses [city-file] [repeat]\n";
+      return 1;
+    }
+    int repeat = args.size() > 1 ? stoi(args[1]) : 100;
+
+    CityStore city_store;
+    if (!parse_cities(args[0], city_store, LoadOptions())) return 1;
+
+    // Junk in every country, and every city with its last letter changed.
+    const char* junk[] = {".DS_Store", ".git", "desktop.ini", "autorun.inf", ".hidden"};
+    vector<pair<size_t, string>> probes;
+    for (size_t country = 0; country < city_store.country_count(); ++country) {
+      for (auto name : junk) probes.emplace_back(country, name);
+    }
+    for (size_t country = 0; country < city_store.country_count(); ++country) {
+      for (auto city = city_store.city_begin(country); city < city_store.city_end(country); ++city) {
+        string name(city_store.city_name(city));
+        name.back() = name.back() == 'x' ? 'y' : 'x';
+        probes.emplace_back(country, name);
+      }
+    }
+
+    auto search = [&city_store](size_t country, string_view name) {
+      auto first = city_store.city_begin(country);
+      auto last = city_store.city_end(country);
+      while (first < last) {
+        auto mid = first + (last - first) / 2;
+        if (city_store.city_name(mid) < name) {
+          first = mid + 1;
+        } else {
+          last = mid;
+        }
+      }
+      return first < city_store.city_end(country) && city_store.city_name(first) == name;
+    };
+
+    auto run = [&](const char* name, function<bool(size_t, string_view)> find) {
+      double best = 0.0;
+      size_t found = 0;
+      for (int i = 0; i < repeat; ++i) {
+        auto start = chrono::steady_clock::now();
+        found = 0;
+        for (auto& probe : probes) found += find(probe.first, probe.second);
+        auto elapsed = seconds_since(start);
+        best = i == 0 ? elapsed : min(best, elapsed);
+      }
+      cout << name << ": " << best * 1e9 / probes.size() << "ns a probe ("
+        << found << " found)\n";
+    };
+
+    size_t passed = 0;
+    for (auto& probe : probes) {
+      passed += city_store.may_have_city(probe.first, probe.second);
+    }
+    cout << probes.size() << " probes, " << passed << " past the filter\n";
+    run("binary search", search);
+    run("name filter", [&city_store](size_t country, string_view name) {
+        return city_store.find_city(country, name) != CityStore::npos;
+      });
+    return 0;
+  }
+
+  // Every display path resolved component by component, then in one
+  // walk of the radix tree.
+  int bench_paths(const vector<string>& args) {
+    if (args.empty()) {
+      cerr << "paths [city-file] [repeat]\n";
+      return 1;
+    }
+    int repeat = args.size() > 1 ? stoi(args[1]) : 100;
+
+    CityStore city_store;
+    if (!parse_cities(args[0], city_store, LoadOptions())) return 1;
+
+    auto start = chrono::steady_clock::now();
+    PathIndex index(city_store);
+    cout << index.size() << " paths, " << index.node_count() << " nodes built in "
+      << seconds_since(start) * 1000.0 << "ms\n";
+
+    vector<string> paths;
+    index.for_each("/", [&paths](string_view path, const PathNode& node) {
+        paths.emplace_back(node.kind == PathNode::City ? city_to_path(path) : string(path));
+        return true;
+      });
+
+    auto run = [&](const char* name, function<PathNode(string_view)> resolve) {
+      double best = 0.0;
+      size_t found = 0;
+      for (int i = 0; i < repeat; ++i) {
+        auto start = chrono::steady_clock::now();
+        found = 0;
+        for (auto& path : paths) found += resolve(path).kind != PathNode::Missing;
+        auto elapsed = seconds_since(start);
+        best = i == 0 ? elapsed : min(best, elapsed);
+      }
+      cout << name << ": " << best * 1e9 / paths.size() << "ns a path ("
+        << found << " found)\n";
+    };
+    run("resolve_path", [&city_store](string_view path) {
+        return resolve_path(city_store, path);
+      });
+    run("radix tree", [&index](string_view path) { return index.find(path); });
+    return 0;
+  }
+
+  // Interning every row's country code and timezone in the ordered map
+  // the builder used to intern with, an unordered_map and the flat index.
+  int bench_intern(const vector<string>& args) {
+    if (args.empty()) {
+      cerr << "intern [city-file] [repeat] [csv|geonames]\n";
+      return 1;
+    }
+    int repeat = args.size() > 1 ? stoi(args[1]) : 100;
+    auto format = args.size() > 2 && args[2] == "geonames" ?
+      CityFormat::geonames() : CityFormat();
+
+    MappedFile file;
+    if (!file.open(args[0])) {
+      cerr << "Error reading " << args[0] << endl;
+      return 1;
+    }
+    vector<string> keys;
+    RowProjection projection(format);
+    projection.scan(file.data(), file.end(), [&](const CityRow& row) {
+        keys.emplace_back(row.country_code);
+        keys.emplace_back(row.timezone);
+      });
+
+    auto run = [&](const char* name, const vector<string>& keys,
+        function<uint32_t(string_view)> intern) {
+      double best = 0.0;
+      uint64_t checksum = 0;
+      for (int i = 0; i < repeat; ++i) {
+        auto start = chrono::steady_clock::now();
+        checksum = 0;
+        for (auto& key : keys) checksum += intern(key);
+        auto elapsed = seconds_since(start);
+        best = i == 0 ? elapsed : min(best, elapsed);
+      }
+      cout << "  " << name << ": " << best * 1e9 / keys.size() << "ns a key ("
+        << checksum << ")\n";
+    };
+
+    map<string, uint32_t, less<>> ordered;
+    unordered_map<string, uint32_t> unordered;
+    vector<string> values;
+    FlatIndex flat;
+    for (auto& key : keys) {
+      auto id = static_cast<uint32_t>(ordered.size());
+      if (ordered.emplace(key, id).second) {
+        unordered.emplace(key, id);
+        values.push_back(key);
+        flat.insert(filter::hash(key), id);
+      }
+    }
+    cout << "country codes and timezones: " << keys.size() << " lookups of "
+      << values.size() << " keys\n";
+
+    run("std::map", keys, [&ordered](string_view key) {
+        return ordered.find(key)->second;
+      });
+    run("std::unordered_map", keys, [&unordered](string_view key) {
+        return unordered.find(string(key))->second;
+      });
+    run("FlatIndex", keys, [&flat, &values](string_view key) {
+        return flat.find(filter::hash(key), [&values, key](uint32_t id) {
+            return values[id] == key;
+          });
+      });
+    return 0;
+  }
+
+  // Every country by code and every city by name, with binary searches
+  // of the sorted columns and with CityStore's lookups, which probe the
+  // image's flat indexes.
+  int bench_lookups(const vector<string>& args) {
+    if (args.empty()) {
+      cerr << "lookups [city-file] [repeat]\n";
+      return 1;
+    }
+    int repeat = args.size() > 1 ? stoi(args[1]) : 100;
+
+    CityStore city_store;
+    if (!parse_cities(args[0], city_store, LoadOptions())) return 1;
+
+    vector<string> codes;
+    vector<pair<size_t, string>> cities;
+    for (size_t country = 0; country < city_store.country_count(); ++country) {
+      codes.emplace_back(city_store.country_code(country));
+      for (auto city = city_store.city_begin(country); city < city_store.city_end(country); ++city) {
+        cities.emplace_back(country, city_store.city_name(city));
+      }
+    }
+
+    auto search_country = [&city_store](string_view code) {
+      size_t first = 0, last = city_store.country_count();
+      while (first < last) {
+        auto mid = first + (last - first) / 2;
+        if (city_store.country_code(mid) < code) {
+          first = mid + 1;
+        } else {
+          last = mid;
+        }
+      }
+      return first;
+    };
+    auto search_city = [&city_store](size_t country, string_view name) {
+      auto first = city_store.city_begin(country);
+      auto last = city_store.city_end(country);
+      while (first < last) {
+        auto mid = first + (last - first) / 2;
+        if (city_store.city_name(mid) < name) {
+          first = mid + 1;
+        } else {
+          last = mid;
+        }
+      }
+      return first;
+    };
+
+    auto time = [repeat](function<size_t()> pass) {
+      double best = 0.0;
+      size_t checksum = 0;
+      for (int i = 0; i < repeat; ++i) {
+        auto start = chrono::steady_clock::now();
+        checksum = pass();
+        auto elapsed = seconds_since(start);
+        best = i == 0 ? elapsed : min(best, elapsed);
+      }
+      return make_pair(best, checksum);
+    };
+    auto report = [](const char* name, pair<double, size_t> result, size_t count) {
+      cout << "  " << name << ": " << result.first * 1e9 / count << "ns a lookup ("
+        << result.second << ")\n";
+    };
+
+    cout << codes.size() << " countries\n";
+    report("binary search", time([&] {
+        size_t sum = 0;
+        for (auto& code : codes) sum += search_country(code);
+        return sum;
+      }), codes.size());
+    report("find_country", time([&] {
+        size_t sum = 0;
+        for (auto& code : codes) sum += city_store.find_country(code);
+        return sum;
+      }), codes.size());
+
+    cout << cities.size() << " cities\n";
+    report("binary search", time([&] {
+        size_t sum = 0;
+        for (auto& city : cities) sum += search_city(city.first, city.second);
+        return sum;
+      }), cities.size());
+    report("find_city", time([&] {
+        size_t sum = 0;
+        for (auto& city : cities) sum += city_store.find_city(city.first, city.second);
+        return sum;
+      }), cities.size());
+    return 0;
+  }
+
+  struct Bench {
+    const char* name;
+    function<int(const vector<string>&)> run;
+  };
+
+  const Bench benches[] = {
+    {"load", bench_load},
+    {"snapshot", bench_snapshot},
+    {"memory", bench_memory},
+    {"country-lookup", bench_country_lookup},
+    {"scan", bench_scan},
+    {"numbers", bench_numbers},
+    {"misses", bench_misses},
+    {"paths", bench_paths},
+    {"intern", bench_intern},
+    {"lookups", bench_lookups},
+  };
+}
+
+int main(int argc, const char* argv[]) {
+  if (argc < 2) {
+    cout << "Usage: " << argv[0] << " [bench] [args...]\n\n";
+    for (auto& bench : benches) {
+      cout << "  " << bench.name << "\n";
+    }
+    return 1;
+  }
+  vector<string> args(argv + 2, argv + argc);
+  for (auto& bench : benches) {
+    if (bench.name == string(argv[1])) {
+      return bench.run(args);
+    }
+  }
+  cerr << "Unknown bench " << argv[1] << endl;
+  return 1;
+}
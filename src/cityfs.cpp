@@ -3,147 +3,306 @@
 
 #include "cityfs.hpp"
 #include "cityfs_util.hpp"
-#include "cityfs_weather.hpp"
+#include "cityfs_csv.hpp"
+#include "cityfs_decompress.hpp"
+#include "cityfs_store.hpp"
+#include "mapped_file.hpp"
+#include <chrono>
+#include <cstring>
+#include <thread>
 
 namespace cityfs {
 
 using namespace std;
 using namespace cityfs::util;
 
+// Stands in for the weather until a city is opened.
+static const string_view WeatherPlaceholder = "                                      ";
 
-string country_to_path(
-      const CountryCodeMap& index,
-      const string& country_code) {
-    auto iter = index.code_to_country.find(country_code);
-    if (iter != index.code_to_country.end()) {
-      return iter->second;  
+string_view country_to_path(string_view country_code) {
+  auto name = country_name_for_code(country_code);
+  return name.empty() ? country_code : name;
+}
+
+string_view path_to_country(string_view country) {
+  auto code = country_code_for_name(country);
+  return code.empty() ? country : code;
+}
+
+string format_coordinate(int32_t value) {
+  auto magnitude = static_cast<uint32_t>(value < 0 ? -int64_t(value) : value);
+  auto whole = magnitude / CoordinateScale;
+  auto fraction = magnitude % CoordinateScale;
+
+  string text = value < 0 ? "-" : "";
+  text += to_string(whole);
+  if (fraction != 0) {
+    char digits[] = "00000";
+    for (int i = 4; i >= 0; --i, fraction /= 10) {
+      digits[i] = static_cast<char>('0' + fraction % 10);
     }
-    return country_code;
+    auto length = strlen(digits);
+    while (digits[length - 1] == '0') --length;
+    text += '.';
+    text.append(digits, length);
   }
+  return text;
+}
+
+static size_t parse_chunk(const char* begin, const char* end, 
+    const RowProjection& projection,
+    CityStoreBuilder& builder,
+    size_t* line = nullptr) {
 
-string path_to_country(
-      const CountryCodeMap& index,
-      const string& country) {
+  return scan_city_rows(begin, end, projection,
+      [&builder](const CityRow& row) {
+        builder.add(row);
+      }, line);
+}
+
+// Parse a compressed city file while the next block is decompressed on
+// another thread.  A line straddling two blocks is stitched together in
+// carry, every other line is parsed in place.
+static bool parse_compressed(const MappedFile& file,
+    Compression compression,
+    const RowProjection& projection,
+    CityStoreBuilder& builder,
+    size_t& rows,
+    size_t& bytes,
+    string& error) {
 
-    auto iter = index.country_to_code.find(country);
-    if (iter != index.code_to_country.end()) {
-      return iter->second;  
+  Decompressor decompressor(file.data(), file.size(), compression);
+  decompressor.start();
+
+  vector<char> block;
+  string carry;
+  size_t line = 1;
+  while (decompressor.next(block)) {
+    bytes += block.size();
+    const char* begin = block.data();
+    auto end = begin + block.size();
+    auto last_line = end;
+    while (last_line > begin && last_line[-1] != '\n') --last_line;
+    if (last_line == begin) {
+      carry.append(begin, end);
+      continue;
     }
-    return country;
+
+    auto pos = begin;
+    if (!carry.empty()) {
+      auto eol = csv::line_end(begin, end);
+      carry.append(begin, eol);
+      rows += parse_chunk(carry.data(), carry.data() + carry.size(), projection, builder, &line);
+      pos = eol + 1;
+    }
+    rows += parse_chunk(pos, last_line, projection, builder, &line);
+    carry.assign(last_line, end);
+  }
+
+  error = decompressor.error();
+  if (!error.empty()) return false;
+  rows += parse_chunk(carry.data(), carry.data() + carry.size(), projection, builder, &line);
+  return true;
+}
+
+// Split [begin, end) into roughly equal chunks that start on a line.
+static vector<const char*> chunk_bounds(const char* begin, const char* end,
+    unsigned chunks) {
+
+  vector<const char*> bounds{begin};
+  auto size = static_cast<size_t>(end - begin);
+  for (unsigned i = 1; i < chunks; ++i) {
+    auto pos = max(begin + size * i / chunks, bounds.back());
+    pos = csv::line_end(pos, end);
+    bounds.push_back(pos == end ? end : pos + 1);
   }
+  bounds.push_back(end);
+  return bounds;
+}
 
 bool parse_cities(const string& path, 
-    unordered_map<string, Country>& countries) {
+    CityStore& city_store,
+    const LoadOptions& options,
+    LoadStats* stats) {
 
-  ifstream ifs;
-  ifs.open(path);
-  if (!ifs.is_open()) {
-    cerr << "Error reading cities.csv" << endl;
+  MappedFile file;
+  if (!file.open(path)) {
+    cerr << "Error reading " << path << endl;
     return false;
   }
-  string line;
-  
-  while(getline(ifs, line)) {
-    City next;
-    string country_code;
-    istringstream iss(line);
-    
-    getline(iss, country_code, ',');
-    getline(iss, next.name, ',');
-    getline(iss, next.latitude, ',');
-    getline(iss, next.longitude, ',');
-    getline(iss, next.population, ',');
-    getline(iss, next.timezone, ',');
-    
-    countries[country_code].city_map.insert(make_pair(next.name, next));
-    countries[country_code].name = country_code;
-  }
-  ifs.close();
-  return true;
+  return parse_cities(path, file, city_store, options, stats);
 }
 
-// Check if a real-path maps to a virtual cityfs path.
-bool virtual_path_exists(
-    const CountryMap& country_map,
-    const CountryCodeMap& country_code_map, 
-    const string& path) {
-
-  auto components = split(path.substr(1), '/');
-  if (components.size() > 0) {
-    
-    // Files look like /Australia/Brisbane.txt, /Australia/Sydney.txt, ...
-    auto code = path_to_country(country_code_map, components[0]);
-    auto country_iter = country_map.find(code);
-    if (country_iter != country_map.end()) {
-      auto country = country_iter->second;
-      
-      // Reading directory
-      if (components.size() == 1) {
-        return true;
-      }
-      if (components.size() > 1) {
-        auto city_name = path_to_city(components[1]);
-        auto city_iter = country.city_map.find(city_name);
-        if (city_iter != country.city_map.end()) {
-          return true;
-        }
+bool parse_cities(const string& path,
+    const MappedFile& file,
+    CityStore& city_store,
+    const LoadOptions& options,
+    LoadStats* stats) {
+
+  auto start = chrono::steady_clock::now();
+  auto threads = options.threads;
+  if (threads == 0) {
+    threads = max(1u, thread::hardware_concurrency());
+  }
+
+  RowProjection projection(options.format);
+  size_t rows = 0;
+  size_t bytes = file.size();
+  CityStoreBuilder builder;
+  auto compression = compression_of(file.data(), file.size());
+  if (compression != Compression::None) {
+    if (!compression_supported(compression)) {
+      cerr << "Error reading " << path << ", cityfs was built without "
+        << compression_name(compression) << " support" << endl;
+      return false;
+    }
+    // One thread decompressing, the other parsing.
+    threads = 2;
+    bytes = 0;
+    string error;
+    if (!parse_compressed(file, compression, projection, builder, rows, bytes, error)) {
+      cerr << "Error decompressing " << path << ": " << error << endl;
+      return false;
+    }
+  } else if (threads == 1) {
+    rows = parse_chunk(file.data(), file.end(), projection, builder);
+  } else {
+    // Each worker fills its own columns, appended in file order so the 
+    // first row for a city still wins.
+    auto bounds = chunk_bounds(file.data(), file.end(), threads);
+    vector<CityStoreBuilder> partials(threads);
+    vector<size_t> chunk_rows(threads);
+    vector<thread> workers;
+    for (unsigned i = 0; i < threads; ++i) {
+      workers.emplace_back([&, i] {
+          chunk_rows[i] = parse_chunk(bounds[i], bounds[i + 1], projection, partials[i]);
+        });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    // Chunks number their lines from 1, so bad rows need the lines
+    // before their chunk added, only counted if there are any.
+    size_t lines = 0;
+    auto counted = file.data();
+    for (unsigned i = 0; i < threads; ++i) {
+      rows += chunk_rows[i];
+      if (partials[i].error_count() > 0) {
+        lines += static_cast<size_t>(count(counted, bounds[i], '\n'));
+        counted = bounds[i];
       }
+      if (!builder.append(partials[i], lines)) break;
     }
   }
-  return false;
+
+  report_errors(path, builder);
+  if (builder.overflowed()) return false;
+  city_store.build(builder);
+
+  if (stats) {
+    stats->rows = rows;
+    stats->bytes = bytes;
+    stats->threads = threads;
+    stats->errors = builder.error_count();
+    stats->seconds = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+  }
+  return true;
 }
 
+bool load_cities(const string& path, 
+    CityStore& city_store,
+    const LoadOptions& options,
+    LoadStats* stats) {
 
-// Get the content for a file.
-// For cityfs, the real-path will always be of the form,
-// /$country/$city.txt
-tuple<string, PathMatch> content_for_path(
-    const CountryMap& country_map,
-    const CountryCodeMap& country_code_map,
-    const string& path, 
-    bool get_weather) {
-
-  auto components = split(path.substr(1), '/');
-  auto result = PathMatch::cityfs_unknown;
-  if (components.size() > 0) {
-    
-    // Files look like /Australia/Brisbane.txt
-    auto country_name = components[0];
-
-    // The virtual fs works with country codes.
-    auto country_code = path_to_country(
-        country_code_map,
-        country_name);
-
-    auto country_iter = country_map.find(country_code);
-    if (country_iter != country_map.end()) {
-      auto country = country_iter->second;
-      
-      if (components.size() == 1) {
-        return make_tuple("", PathMatch::cityfs_country);
-      }
+  if (!CityStore::is_snapshot(path)) {
+    return parse_cities(path, city_store, options, stats);
+  }
 
-      if (components.size() == 2) {
-        auto city_name = path_to_city(components[1]);
-
-        auto city_iter = country.city_map.find(city_name);
-
-        if (city_iter != country.city_map.end()) {
-          auto city = city_iter->second;
-          ostringstream oss;
-          oss << city.name << "," << city.latitude << "," << city.longitude;
-          if (get_weather) {
-            oss << "," << weather_content(city.name);
-          } else {
-            oss << "                                      ";
-          }
-          oss << "\n";
-          return make_tuple(oss.str(), PathMatch::cityfs_city);
-        }
-      }
-    }
+  auto start = chrono::steady_clock::now();
+  if (!city_store.load(path)) return false;
+  if (stats) {
+    stats->rows = city_store.city_count();
+    stats->bytes = city_store.image_size();
+    stats->threads = 1;
+    stats->seconds = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+  }
+  return true;
+}
+
+PathNode resolve_path(
+    const CityStore& city_store,
+    string_view path) {
+
+  PathNode node;
+  if (path.empty() || path[0] != '/') return node;
+  if (path.size() == 1) {
+    node.kind = PathNode::Root;
+    return node;
+  }
+
+  // Files look like /Australia/Brisbane.txt, the store works with codes.
+  Tokens components(path.substr(1), '/');
+  auto component = components.begin();
+  auto country = city_store.find_country(path_to_country(*component));
+  if (country == CityStore::npos) return node;
+  if (++component == components.end()) {
+    node.kind = PathNode::Country;
+    node.country = country;
+    return node;
+  }
+
+  auto city = city_store.find_city(country, path_to_city(*component));
+  if (city == CityStore::npos || ++component != components.end()) return node;
+  node.kind = PathNode::City;
+  node.country = country;
+  node.city = city;
+  return node;
+}
+
+// Length of format_coordinate(value).
+static size_t coordinate_length(int32_t value) {
+  auto magnitude = static_cast<uint32_t>(value < 0 ? -int64_t(value) : value);
+  auto whole = magnitude / CoordinateScale;
+  auto fraction = magnitude % CoordinateScale;
+
+  size_t length = value < 0 ? 2 : 1;
+  for (; whole >= 10; whole /= 10) ++length;
+  if (fraction != 0) {
+    size_t digits = CoordinateDigits;
+    for (; fraction % 10 == 0; fraction /= 10) --digits;
+    length += 1 + digits;
+  }
+  return length;
+}
+
+size_t city_content_size(
+    const CityStore& city_store,
+    size_t city_index) {
+
+  auto city = city_store.city(city_index);
+  return city.name.size() + 1 + coordinate_length(city.latitude) + 1 +
+    coordinate_length(city.longitude) + WeatherPlaceholder.size() + 1;
+}
+
+string city_content(
+    const CityStore& city_store,
+    size_t city_index,
+    const string* weather) {
+
+  auto city = city_store.city(city_index);
+  ostringstream oss;
+  oss << city.name << "," 
+    << format_coordinate(city.latitude) << "," 
+    << format_coordinate(city.longitude);
+  if (weather) {
+    oss << "," << *weather;
+  } else {
+    oss << WeatherPlaceholder;
   }
-  return make_tuple("", result);
+  oss << "\n";
+  return oss.str();
 }
 
 }
@@ -10,85 +10,128 @@
 #include <fstream>
 #include <sstream>
 #include <tuple>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
 #include "country_codes.hpp"
+#include "cityfs_csv.hpp"
+#include "cityfs_number.hpp"
 #include "cityfs_util.hpp"
 
 namespace cityfs {
 
-  enum class PathMatch {
-    cityfs_unknown,
-    cityfs_city,
-    cityfs_country
+  // What a path resolved to: the root, a country directory or a city
+  // file, by its index in the store.
+  struct PathNode {
+    enum Kind {
+      Missing,
+      Root,
+      Country,
+      City
+    };
+    static const size_t NoIndex = ~size_t(0);
+
+    Kind kind = Missing;
+    size_t country = NoIndex;
+    size_t city = NoIndex;
   };
 
-  struct City {
-    std::string name;
-    std::string latitude;
-    std::string longitude;
-    std::string population;
-    std::string timezone;
-  };
+  // Render a fixed-point coordinate without trailing zeros, eg, -27.46794.
+  std::string format_coordinate(int32_t value);
 
-  inline std::string city_to_path(const std::string& name) { 
-    return name + ".txt"; 
+  inline std::string city_to_path(std::string_view name) { 
+    return std::string(name) + ".txt"; 
   }
 
-  inline std::string path_to_city(const std::string& path) {
-    return util::trim_extension(path);
+  inline std::string_view path_to_city(std::string_view path) {
+    return path.substr(0, path.rfind('.'));
   }
 
-  inline std::ostream& operator<<(std::ostream& os, const City& rhs) {
-    os << rhs.name << ", "
-      << rhs.latitude << ", "
-      << rhs.longitude << ", "
-      << rhs.population << ", "
-      << rhs.timezone;
-    return os;
-  }
+  // Directory name for a country code, the code itself if unknown.
+  std::string_view country_to_path(std::string_view country_code);
 
-  struct Country {
-    std::string name;
-    std::vector<std::string> city_names;
-    std::unordered_map<std::string, City> city_map;
-  };
+  // Country code for a directory name, the name itself if unknown.
+  std::string_view path_to_country(std::string_view country);
+
+  // Throughput of a city file load.
+  struct LoadStats {
+    size_t rows = 0;
+    size_t bytes = 0;
+    unsigned threads = 1;
+    double seconds = 0.0;
+    // Rows skipped for a coordinate or population that didn't parse.
+    size_t errors = 0;
 
-  inline std::ostream& operator<<(std::ostream& os, const Country& c) {
-    os << c.name << ":" << std::endl;
-    for (auto city_pair : c.city_map) {
-      os << city_pair.second << std::endl;
+    double rows_per_sec() const { 
+      return seconds > 0.0 ? rows / seconds : 0.0; 
     }
+  };
+
+  inline std::ostream& operator<<(std::ostream& os, const LoadStats& rhs) {
+    os << rhs.rows << " rows, "
+      << rhs.bytes << " bytes in "
+      << rhs.seconds * 1000.0 << "ms on "
+      << rhs.threads << " thread(s) ("
+      << static_cast<size_t>(rhs.rows_per_sec()) << " rows/sec)";
+    if (rhs.errors > 0) os << ", " << rhs.errors << " bad row(s) skipped";
     return os;
   }
 
-  typedef std::unordered_map<std::string, Country> CountryMap;
+  struct LoadOptions {
+    // Worker threads parsing newline-aligned chunks, 0 for one per core.
+    unsigned threads = 1;
+
+    // Layout of the city file's columns and rows to keep.
+    CityFormat format;
 
-  std::string country_to_path(
-      const CountryCodeMap& index,
-      const std::string& country_code);
+    // Where --lazy keeps the .cfsidx sidecar, next to the city file if
+    // empty, eg, a cache directory for a read-only city file.
+    std::string index_dir;
+  };
 
-  std::string path_to_country(
-      const CountryCodeMap& index,
-      const std::string& country);
+  class CityStore;
+  class MappedFile;
 
+  // Load a city file by mapping it and scanning the fields in place.
   bool parse_cities(
       const std::string& path, 
-      std::unordered_map<std::string, Country>& countries);
+      CityStore& city_store,
+      const LoadOptions& options,
+      LoadStats* stats = nullptr);
 
-
-  // Check if a real-path maps to a virtual cityfs path.
-  bool virtual_path_exists(
-      const CountryMap& country_map,
-      const CountryCodeMap& country_code_map, 
-      const std::string& path);
-
-  // Get the content for a file.
-  // For cityfs, the real-path will always be of the form,
-  // /$country/$city.txt
-  std::tuple<std::string, PathMatch> content_for_path(
-      const CountryMap& country_map,
-      const CountryCodeMap& country_code_map,
+  // Load the city file at path from file, its mapping, eg, to index its
+  // lines from the same bytes.
+  bool parse_cities(
+      const std::string& path,
+      const MappedFile& file,
+      CityStore& city_store,
+      const LoadOptions& options,
+      LoadStats* stats = nullptr);
+
+  // Load either a compiled snapshot or a city file to parse.
+  bool load_cities(
       const std::string& path, 
-      bool get_weather=false);
+      CityStore& city_store,
+      const LoadOptions& options,
+      LoadStats* stats = nullptr);
+
+  // Resolve a real-path, /, /$country or /$country/$city.txt, in one
+  // pass over it without allocating.
+  PathNode resolve_path(
+      const CityStore& city_store,
+      std::string_view path);
+
+  // The content of a city's file, with its weather, or a placeholder
+  // for it if null.
+  std::string city_content(
+      const CityStore& city_store,
+      size_t city,
+      const std::string* weather = nullptr);
+
+  // city_content(city_store, city).size(), without rendering it.
+  size_t city_content_size(
+      const CityStore& city_store,
+      size_t city);
 }
 
 #endif
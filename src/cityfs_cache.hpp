@@ -0,0 +1,153 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_CACHE_HPP
+#define CITYFS_CACHE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "cityfs_filter.hpp"
+
+namespace cityfs {
+
+  // A bounded cache of what paths resolved to, misses included, so hot
+  // paths skip tokenizing and searching.  Paths are spread over shards
+  // by hash, each its own LRU behind its own lock.  Entries are tagged
+  // with the store generation they were resolved against, and a shard
+  // seeing a newer generation drops everything it has.  expire() drops
+  // them from every shard at once, so idle shards don't keep the old
+  // store alive, carry() keeps those still good for the next store.
+  template <typename Value>
+    class PathCache {
+      public:
+        static const size_t Shards = 16;
+
+        struct Stats {
+          uint64_t hits;
+          uint64_t misses;
+          uint64_t evictions;
+          size_t size;
+        };
+
+        explicit PathCache(size_t capacity):
+          _shard_capacity(capacity / Shards > 0 ? capacity / Shards : 1),
+          _shards(new Shard[Shards]) {}
+
+        // The value path resolved to in generation, if it's cached.
+        bool find(std::string_view path, uint64_t generation, Value& value) {
+          auto h = filter::hash(path);
+          auto& shard = shard_for(h);
+          std::lock_guard<std::mutex> lock(shard.mutex);
+          shard.expire(generation);
+          auto iter = shard.index.find(h);
+          if (iter == shard.index.end() || iter->second->path != path) {
+            _misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+          }
+          shard.entries.splice(shard.entries.begin(), shard.entries, iter->second);
+          value = iter->second->value;
+          _hits.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        }
+
+        // Cache what path resolved to in generation, unless the shard
+        // has moved on to a newer one since.
+        void insert(std::string_view path, uint64_t generation, Value value) {
+          auto h = filter::hash(path);
+          auto& shard = shard_for(h);
+          std::lock_guard<std::mutex> lock(shard.mutex);
+          shard.expire(generation);
+          if (shard.generation != generation) return;
+
+          auto iter = shard.index.find(h);
+          if (iter != shard.index.end()) {
+            shard.entries.erase(iter->second);
+            shard.index.erase(iter);
+          } else if (shard.entries.size() == _shard_capacity) {
+            shard.index.erase(shard.entries.back().hash);
+            shard.entries.pop_back();
+            _evictions.fetch_add(1, std::memory_order_relaxed);
+          }
+          shard.entries.push_front({h, std::string(path), std::move(value)});
+          shard.index.emplace(h, shard.entries.begin());
+        }
+
+        // Drop everything resolved before generation, eg, just before a
+        // store of that generation is published.
+        void expire(uint64_t generation) {
+          for (size_t i = 0; i < Shards; ++i) {
+            std::lock_guard<std::mutex> lock(_shards[i].mutex);
+            _shards[i].expire(generation);
+          }
+        }
+
+        // Carry everything resolved before generation over to it, eg, for
+        // a store patched from the last one.  update rewrites a value for
+        // generation, or returns false to drop it.
+        template <typename Update>
+          void carry(uint64_t generation, const Update& update) {
+            for (size_t i = 0; i < Shards; ++i) {
+              auto& shard = _shards[i];
+              std::lock_guard<std::mutex> lock(shard.mutex);
+              if (generation <= shard.generation) continue;
+              shard.generation = generation;
+              for (auto iter = shard.entries.begin(); iter != shard.entries.end();) {
+                if (update(iter->path, iter->value)) {
+                  ++iter;
+                } else {
+                  shard.index.erase(iter->hash);
+                  iter = shard.entries.erase(iter);
+                }
+              }
+            }
+          }
+
+        Stats stats() const {
+          size_t size = 0;
+          for (size_t i = 0; i < Shards; ++i) {
+            std::lock_guard<std::mutex> lock(_shards[i].mutex);
+            size += _shards[i].entries.size();
+          }
+          return {_hits.load(), _misses.load(), _evictions.load(), size};
+        }
+
+      private:
+        struct Entry {
+          uint64_t hash;
+          std::string path;
+          Value value;
+        };
+
+        struct Shard {
+          mutable std::mutex mutex;
+          uint64_t generation = 0;
+          std::list<Entry> entries;
+          std::unordered_map<uint64_t, typename std::list<Entry>::iterator> index;
+
+          void expire(uint64_t current) {
+            if (current <= generation) return;
+            index.clear();
+            entries.clear();
+            generation = current;
+          }
+        };
+
+        // The low bits pick the bucket in a shard's index, so the high
+        // ones pick the shard.
+        Shard& shard_for(uint64_t h) { return _shards[(h >> 60) % Shards]; }
+
+        size_t _shard_capacity;
+        std::unique_ptr<Shard[]> _shards;
+        std::atomic<uint64_t> _hits{0};
+        std::atomic<uint64_t> _misses{0};
+        std::atomic<uint64_t> _evictions{0};
+    };
+}
+
+#endif
@@ -0,0 +1,279 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_CSV_HPP
+#define CITYFS_CSV_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cityfs_number.hpp"
+#include "cityfs_simd.hpp"
+
+namespace cityfs {
+
+  // One row of the city file, (country-code,city,lat,lng,population,timezone).
+  // Fields are views into the scanned buffer, nothing is copied.
+  struct CityRow {
+    std::string_view country_code;
+    std::string_view name;
+    std::string_view latitude;
+    std::string_view longitude;
+    std::string_view population;
+    std::string_view timezone;
+    std::string_view feature_class;
+
+    // Line number in the file, counting from 1, for error messages.
+    size_t line = 0;
+  };
+
+  // Which column of the city file each CityRow field comes from, and
+  // which rows to keep.  The default is the six column CSV.
+  struct CityFormat {
+    enum Field {
+      CountryCode,
+      Name,
+      Latitude,
+      Longitude,
+      Population,
+      Timezone,
+      FeatureClass,
+      FieldCount
+    };
+    static const unsigned NoColumn = ~0u;
+
+    static const char* field_name(Field field) {
+      static const char* names[FieldCount] = {
+        "country code", "name", "latitude", "longitude", "population",
+        "timezone", "feature class"
+      };
+      return field < FieldCount ? names[field] : "field";
+    }
+
+    char delimiter = ',';
+    unsigned columns[FieldCount] = {0, 1, 2, 3, 4, 5, NoColumn};
+
+    // Fields may be "quoted" to hold the delimiter, though not newlines.
+    bool quoted = true;
+
+    // Feature classes to keep, eg, "P" for populated places, any if empty.
+    std::string feature_classes;
+    uint32_t min_population = 0;
+
+    // GeoNames dumps, eg, allCountries.txt or cities500.txt, keeping
+    // populated places.
+    static CityFormat geonames() {
+      CityFormat format;
+      format.delimiter = '\t';
+      format.quoted = false;
+      unsigned columns[FieldCount] = {8, 1, 4, 5, 14, 17, 6};
+      std::copy(columns, columns + FieldCount, format.columns);
+      format.feature_classes = "P";
+      return format;
+    }
+  };
+
+  namespace csv {
+
+    // Split the next field off [pos, end), leaving pos past the delimiter.
+    inline std::string_view next_field(
+        const char*& pos, 
+        const char* end, 
+        char delimiter) {
+
+      auto start = pos;
+      auto hit = static_cast<const char*>(
+          memchr(pos, delimiter, static_cast<size_t>(end - pos)));
+      if (hit == nullptr) {
+        pos = end;
+        return std::string_view(start, static_cast<size_t>(end - start));
+      }
+      pos = hit + 1;
+      return std::string_view(start, static_cast<size_t>(hit - start));
+    }
+
+    // Find the end of the line starting at pos, or end if it's the last.
+    inline const char* line_end(const char* pos, const char* end) {
+      auto hit = static_cast<const char*>(
+          memchr(pos, '\n', static_cast<size_t>(end - pos)));
+      return hit == nullptr ? end : hit;
+    }
+  }
+
+  // A CityFormat ready for splitting rows.  Rows are split on bitmaps of
+  // the delimiters, newlines and quotes in each 64 byte block, found with
+  // the widest SIMD the CPU has.  Columns past the last one used are
+  // skipped newline to newline.
+  class RowProjection {
+    public:
+      explicit RowProjection(const CityFormat& format = CityFormat()):
+        _delimiter(format.delimiter),
+        _quoted(format.quoted),
+        _feature_classes(format.feature_classes),
+        _min_population(format.min_population),
+        _scanner(simd::block_scanner()) {
+
+        static std::string_view CityRow::* const fields[CityFormat::FieldCount] = {
+          &CityRow::country_code, &CityRow::name, &CityRow::latitude,
+          &CityRow::longitude, &CityRow::population, &CityRow::timezone,
+          &CityRow::feature_class
+        };
+        for (int field = 0; field < CityFormat::FieldCount; ++field) {
+          auto column = format.columns[field];
+          if (column == CityFormat::NoColumn) continue;
+          if (column >= _columns.size()) _columns.resize(column + 1, nullptr);
+          _columns[column] = fields[field];
+        }
+      }
+
+      char delimiter() const { return _delimiter; }
+
+      // Use a particular block scanner, eg, to benchmark them.
+      void set_scanner(simd::BlockScanner scanner) { _scanner = scanner; }
+
+      // Split one line into row, false if the format's filters drop it.
+      bool project(std::string_view line, CityRow& row) const {
+        bool kept = false;
+        scan(line.data(), line.data() + line.size(), [&](const CityRow& projected) {
+            row = projected;
+            kept = true;
+          });
+        return kept;
+      }
+
+      // Call on_row(const CityRow&) for each non-empty row in [begin, end)
+      // the filters keep.  Returns the number of rows kept.  Lines are
+      // numbered from *line if given, left at the number of the next line.
+      template <typename RowHandler>
+        size_t scan(const char* begin, const char* end, RowHandler on_row,
+            size_t* line_number = nullptr) const {
+          size_t rows = 0;
+          size_t number = line_number ? *line_number : 1;
+          CityRow row;
+          size_t column = 0;
+          bool in_quotes = false;
+          auto line = begin;
+          auto field = begin;
+
+          auto end_field = [&](const char* pos) {
+            if (column < _columns.size() && _columns[column] != nullptr) {
+              row.*_columns[column] = unquote(field, pos);
+            }
+            ++column;
+            field = pos + 1;
+          };
+          auto end_line = [&](const char* pos) {
+            if (pos > line && pos[-1] == '\r') --pos;
+            if (column < _columns.size()) end_field(pos);
+            row.line = number++;
+            if (pos > line && accepts(row)) {
+              on_row(static_cast<const CityRow&>(row));
+              ++rows;
+            }
+            row = CityRow();
+            column = 0;
+            in_quotes = false;
+          };
+
+          // Past the last column used, only the next newline matters.
+          bool skipping = _columns.empty();
+          for (auto block = begin; block < end; block += simd::BlockSize) {
+            auto size = std::min(static_cast<size_t>(end - block), simd::BlockSize);
+            auto masks = _scanner(block, size, _delimiter);
+            auto all = masks.delimiters | masks.newlines | (_quoted ? masks.quotes : 0);
+            auto structural = skipping ? masks.newlines : all;
+
+            while (structural != 0) {
+              auto bit = __builtin_ctzll(structural);
+              structural &= structural - 1;
+              auto pos = block + bit;
+              auto c = *pos;
+
+              if (c == '\n') {
+                end_line(pos);
+                line = field = pos + 1;
+                if (skipping) {
+                  skipping = _columns.empty();
+                  structural = all & ~(bit == 63 ? ~uint64_t(0) : (uint64_t(2) << bit) - 1);
+                }
+              } else if (in_quotes) {
+                if (c == '"') in_quotes = false;
+              } else if (c == '"') {
+                // Quotes only open at the start of a field.
+                if (pos == field) in_quotes = true;
+              } else {
+                end_field(pos);
+                if (column >= _columns.size()) {
+                  skipping = true;
+                  structural &= masks.newlines;
+                }
+              }
+            }
+          }
+          if (line < end) end_line(end);
+          if (line_number) *line_number = number;
+          return rows;
+        }
+
+    private:
+      static std::string_view unquote(const char* begin, const char* end) {
+        if (end - begin >= 2 && *begin == '"' && end[-1] == '"') {
+          ++begin;
+          --end;
+        }
+        return std::string_view(begin, static_cast<size_t>(end - begin));
+      }
+
+      bool accepts(const CityRow& row) const {
+        if (!_feature_classes.empty() &&
+            (row.feature_class.size() != 1 ||
+             _feature_classes.find(row.feature_class[0]) == std::string::npos)) {
+          return false;
+        }
+        if (_min_population > 0) {
+          uint32_t population = 0;
+          parse_population(row.population, population);
+          if (population < _min_population) return false;
+        }
+        return true;
+      }
+
+      char _delimiter;
+      bool _quoted;
+      std::vector<std::string_view CityRow::*> _columns;
+      std::string _feature_classes;
+      uint32_t _min_population;
+      simd::BlockScanner _scanner;
+  };
+
+  // Call on_line(std::string_view) for each non-empty line in [begin, end),
+  // without its line ending.
+  template <typename LineHandler>
+    void for_each_line(const char* begin, const char* end, LineHandler on_line) {
+      auto pos = begin;
+      while (pos < end) {
+        auto eol = csv::line_end(pos, end);
+        auto last = eol;
+        if (last > pos && last[-1] == '\r') --last;
+
+        if (last > pos) {
+          on_line(std::string_view(pos, static_cast<size_t>(last - pos)));
+        }
+        pos = eol + 1;
+      }
+    }
+
+  // Scan the city rows in [begin, end) in place, calling on_row(const CityRow&)
+  // for each non-empty line the projection keeps.  Returns the number of
+  // rows kept.
+  template <typename RowHandler>
+    size_t scan_city_rows(const char* begin, const char* end,
+        const RowProjection& projection, RowHandler on_row,
+        size_t* line_number = nullptr) {
+      return projection.scan(begin, end, on_row, line_number);
+    }
+}
+
+#endif
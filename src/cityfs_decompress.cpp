@@ -0,0 +1,234 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#include "cityfs_decompress.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#ifdef CITYFS_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CITYFS_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace cityfs {
+
+using namespace std;
+
+Compression compression_of(const char* data, size_t size) {
+  static const unsigned char gzip_magic[] = {0x1f, 0x8b};
+  static const unsigned char zstd_magic[] = {0x28, 0xb5, 0x2f, 0xfd};
+  if (size >= sizeof(gzip_magic) && memcmp(data, gzip_magic, sizeof(gzip_magic)) == 0) {
+    return Compression::Gzip;
+  }
+  if (size >= sizeof(zstd_magic) && memcmp(data, zstd_magic, sizeof(zstd_magic)) == 0) {
+    return Compression::Zstd;
+  }
+  return Compression::None;
+}
+
+Compression compression_of(const string& path) {
+  char magic[4] = {0};
+  ifstream in(path, ios::binary);
+  in.read(magic, sizeof(magic));
+  return compression_of(magic, static_cast<size_t>(in.gcount()));
+}
+
+const char* compression_name(Compression compression) {
+  switch (compression) {
+    case Compression::Gzip: return "gzip";
+    case Compression::Zstd: return "zstd";
+    default: return "none";
+  }
+}
+
+bool compression_supported(Compression compression) {
+  switch (compression) {
+    case Compression::None: return true;
+#ifdef CITYFS_HAVE_ZLIB
+    case Compression::Gzip: return true;
+#endif
+#ifdef CITYFS_HAVE_ZSTD
+    case Compression::Zstd: return true;
+#endif
+    default: return false;
+  }
+}
+
+Decompressor::Decompressor(const char* data, size_t size, Compression compression):
+  _data(data), _size(size), _compression(compression) {}
+
+Decompressor::~Decompressor() {
+  {
+    lock_guard<mutex> lock(_mutex);
+    _cancelled = true;
+  }
+  _drained.notify_all();
+  if (_thread.joinable()) _thread.join();
+}
+
+void Decompressor::start() {
+  _thread = thread(&Decompressor::run, this);
+}
+
+bool Decompressor::next(vector<char>& block) {
+  unique_lock<mutex> lock(_mutex);
+  if (block.capacity() > 0) {
+    block.clear();
+    _free.push_back(move(block));
+    _drained.notify_one();
+  }
+  _filled.wait(lock, [this] { return !_blocks.empty() || _done; });
+  if (_blocks.empty()) return false;
+  block = move(_blocks.front());
+  _blocks.pop_front();
+  _drained.notify_one();
+  return true;
+}
+
+bool Decompressor::acquire(vector<char>& block) {
+  unique_lock<mutex> lock(_mutex);
+  _drained.wait(lock, [this] { return _blocks.size() < MaxBlocks || _cancelled; });
+  if (_cancelled) return false;
+  if (!_free.empty()) {
+    block = move(_free.back());
+    _free.pop_back();
+  }
+  block.resize(BlockSize);
+  return true;
+}
+
+void Decompressor::push(vector<char>& block) {
+  {
+    lock_guard<mutex> lock(_mutex);
+    _blocks.push_back(move(block));
+  }
+  _filled.notify_one();
+  block = vector<char>();
+}
+
+void Decompressor::finish(string error) {
+  {
+    lock_guard<mutex> lock(_mutex);
+    _error = move(error);
+    if (!_error.empty()) _blocks.clear();
+    _done = true;
+  }
+  _filled.notify_all();
+}
+
+void Decompressor::run() {
+  switch (_compression) {
+    case Compression::Gzip:
+      inflate_gzip();
+      break;
+    case Compression::Zstd:
+      inflate_zstd();
+      break;
+    default:
+      finish(string("no decompressor for ") + compression_name(_compression));
+      break;
+  }
+}
+
+bool Decompressor::inflate_gzip() {
+#ifdef CITYFS_HAVE_ZLIB
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  // 32 lets zlib detect gzip or zlib headers.
+  if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+    finish("inflateInit2 failed");
+    return false;
+  }
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(_data));
+  stream.avail_in = 0;
+  size_t remaining = _size;
+
+  vector<char> block;
+  int result = Z_OK;
+  while (true) {
+    if (!acquire(block)) break;
+    stream.next_out = reinterpret_cast<Bytef*>(block.data());
+    stream.avail_out = static_cast<uInt>(block.size());
+
+    while (stream.avail_out > 0) {
+      if (stream.avail_in == 0 && remaining > 0) {
+        auto chunk = min<size_t>(remaining, UINT32_MAX);
+        stream.avail_in = static_cast<uInt>(chunk);
+        remaining -= chunk;
+      }
+      result = inflate(&stream, Z_NO_FLUSH);
+      if (result == Z_STREAM_END) {
+        // Concatenated members, eg, from pigz or cat a.gz b.gz.
+        if (stream.avail_in == 0 && remaining == 0) break;
+        inflateReset(&stream);
+        result = Z_OK;
+        continue;
+      }
+      if (result != Z_OK) break;
+    }
+
+    block.resize(block.size() - stream.avail_out);
+    if (!block.empty()) push(block);
+    if (result != Z_OK) break;
+  }
+  inflateEnd(&stream);
+
+  if (result != Z_OK && result != Z_STREAM_END) {
+    finish(result == Z_BUF_ERROR ? "truncated gzip input" :
+        stream.msg ? stream.msg : "inflate failed");
+    return false;
+  }
+  finish("");
+  return true;
+#else
+  finish("built without zlib");
+  return false;
+#endif
+}
+
+bool Decompressor::inflate_zstd() {
+#ifdef CITYFS_HAVE_ZSTD
+  auto stream = ZSTD_createDStream();
+  if (stream == nullptr) {
+    finish("ZSTD_createDStream failed");
+    return false;
+  }
+  ZSTD_initDStream(stream);
+  ZSTD_inBuffer input = {_data, _size, 0};
+
+  vector<char> block;
+  size_t result = 0;
+  string error;
+  bool more = true;
+  while (more && acquire(block)) {
+    ZSTD_outBuffer output = {block.data(), block.size(), 0};
+    while (output.pos < output.size) {
+      result = ZSTD_decompressStream(stream, &output, &input);
+      if (ZSTD_isError(result)) {
+        error = ZSTD_getErrorName(result);
+        more = false;
+        break;
+      }
+      // Room left over with the input used up means it's all flushed.
+      if (input.pos == input.size && output.pos < output.size) {
+        more = false;
+        break;
+      }
+    }
+    block.resize(output.pos);
+    if (!block.empty()) push(block);
+  }
+  // Anything but 0 means the last frame was cut short.
+  if (error.empty() && result != 0) error = "truncated zstd input";
+  ZSTD_freeDStream(stream);
+  finish(error);
+  return error.empty();
+#else
+  finish("built without zstd");
+  return false;
+#endif
+}
+
+}
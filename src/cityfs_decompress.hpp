@@ -0,0 +1,80 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_DECOMPRESS_HPP
+#define CITYFS_DECOMPRESS_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cityfs {
+
+  enum class Compression {
+    None,
+    Gzip,
+    Zstd
+  };
+
+  // Sniff the compression of a file from its first bytes.
+  Compression compression_of(const char* data, size_t size);
+  Compression compression_of(const std::string& path);
+
+  const char* compression_name(Compression compression);
+
+  // False if cityfs was built without the library for it.
+  bool compression_supported(Compression compression);
+
+  // Decompresses [data, data + size) on a background thread into a
+  // bounded queue of blocks, so a reader parses one block while the next
+  // is inflated.  Blocks end anywhere, lines may straddle them.
+  class Decompressor {
+    public:
+      static const size_t BlockSize = 1 << 20;
+      static const size_t MaxBlocks = 4;
+
+      Decompressor(const char* data, size_t size, Compression compression);
+      ~Decompressor();
+
+      Decompressor(const Decompressor&) = delete;
+      Decompressor& operator=(const Decompressor&) = delete;
+
+      void start();
+
+      // Swap the next block into block, handing the old one back for
+      // reuse.  Returns false at the end of the input or on an error.
+      bool next(std::vector<char>& block);
+
+      // Set once next() has returned false if decompression failed.
+      const std::string& error() const { return _error; }
+
+    private:
+      void run();
+      bool inflate_gzip();
+      bool inflate_zstd();
+
+      // Producer side: a free block to fill, and publishing it.
+      bool acquire(std::vector<char>& block);
+      void push(std::vector<char>& block);
+      void finish(std::string error);
+
+      const char* _data;
+      size_t _size;
+      Compression _compression;
+      std::thread _thread;
+
+      std::mutex _mutex;
+      std::condition_variable _filled;
+      std::condition_variable _drained;
+      std::deque<std::vector<char>> _blocks;
+      std::vector<std::vector<char>> _free;
+      bool _done = false;
+      bool _cancelled = false;
+      std::string _error;
+  };
+}
+
+#endif
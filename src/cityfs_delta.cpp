@@ -0,0 +1,239 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#include "cityfs_delta.hpp"
+#include "cityfs_csv.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <functional>
+
+namespace cityfs {
+
+using namespace std;
+
+// A line with no city in the store, filtered out or rejected.
+static const uint32_t Dropped = UINT32_MAX;
+
+static uint64_t line_hash(string_view line) {
+  return hash<string_view>()(line);
+}
+
+static size_t find_city(const CityStore& city_store,
+    string_view code, string_view name) {
+  auto country = city_store.find_country(code);
+  if (country == CityStore::npos) return CityStore::npos;
+  return city_store.find_city(country, name.substr(0, UINT16_MAX));
+}
+
+namespace {
+
+  // Walks a store's cities in (country code, name) order.
+  class CityCursor {
+    public:
+      CityCursor(const CityStore& city_store): _store(city_store) {
+        skip_empty();
+      }
+
+      bool done() const { return _city >= _store.city_count(); }
+      size_t city() const { return _city; }
+      string_view code() const { return _store.country_code(_country); }
+      string_view name() const { return _store.city_name(_city); }
+
+      void next() {
+        ++_city;
+        skip_empty();
+      }
+
+      bool operator<(const CityCursor& rhs) const {
+        auto lhs_code = code(), rhs_code = rhs.code();
+        if (lhs_code != rhs_code) return lhs_code < rhs_code;
+        return name() < rhs.name();
+      }
+
+    private:
+      void skip_empty() {
+        while (_country < _store.country_count() &&
+            _city >= _store.city_end(_country)) {
+          ++_country;
+        }
+      }
+
+      const CityStore& _store;
+      size_t _city = 0;
+      size_t _country = 0;
+  };
+}
+
+static bool same_values(const CityView& a, const CityView& b) {
+  return a.latitude == b.latitude && a.longitude == b.longitude &&
+    a.population == b.population && a.timezone == b.timezone;
+}
+
+void RowIndex::build(const MappedFile& file, const CityStore& city_store) {
+  _lines.clear();
+  CityRow row;
+  for_each_line(file.data(), file.end(), [&](string_view line) {
+      auto id = Dropped;
+      if (_projection.project(line, row)) {
+        auto city = find_city(city_store, row.country_code, row.name);
+        if (city != CityStore::npos) id = static_cast<uint32_t>(city);
+      }
+      _lines.push_back({line_hash(line), id});
+    });
+
+  sort(_lines.begin(), _lines.end(), [](const Line& a, const Line& b) {
+      return a.hash < b.hash;
+    });
+}
+
+bool RowIndex::apply(
+    const string& city_file,
+    const CityStore& base,
+    CityStore& patched,
+    StoreChanges& changes) {
+
+  changes.clear();
+
+  MappedFile file;
+  if (!file.open(city_file)) return false;
+
+  // Number lines as the full load does, counting the empty ones
+  // for_each_line skips.
+  struct FileLine {
+    uint64_t hash;
+    string_view text;
+    size_t number;
+  };
+  vector<FileLine> lines;
+  lines.reserve(_lines.size());
+  auto counted = file.data();
+  size_t number = 1;
+  for_each_line(file.data(), file.end(), [&](string_view line) {
+      number += count(counted, line.data(), '\n');
+      counted = line.data();
+      lines.push_back({line_hash(line), line, number});
+    });
+  sort(lines.begin(), lines.end(), [](const FileLine& a, const FileLine& b) {
+      return a.hash < b.hash;
+    });
+
+  // Lines only in the index were removed or changed, lines only in the
+  // file were added or changed.  A city with either needs its row
+  // picked again.
+  struct KeptLine {
+    Line line;
+    string_view text;
+    size_t number;
+  };
+  vector<bool> affected(base.city_count());
+  vector<KeptLine> kept;
+  vector<FileLine> added;
+  kept.reserve(_lines.size());
+  size_t i = 0, j = 0;
+  while (i < _lines.size() || j < lines.size()) {
+    if (j == lines.size() || (i < _lines.size() && _lines[i].hash < lines[j].hash)) {
+      auto city = _lines[i].city;
+      if (city != Dropped) affected[city] = true;
+      ++i;
+    } else if (i == _lines.size() || lines[j].hash < _lines[i].hash) {
+      added.push_back(lines[j]);
+      ++j;
+    } else {
+      kept.push_back({_lines[i], lines[j].text, lines[j].number});
+      ++i;
+      ++j;
+    }
+  }
+  if (added.empty() && kept.size() == _lines.size()) return true;
+
+  // The first line of a duplicate city wins, so every line of an affected
+  // city is a candidate, parsed in file order.  Only these are parsed.
+  // Bad rows among them are reported as the full load reports them.
+  struct Candidate {
+    string_view text;
+    size_t number;
+  };
+  vector<Candidate> candidates;
+  CityRow row;
+  for (auto& line : added) {
+    if (!_projection.project(line.text, row)) continue;
+    candidates.push_back({line.text, line.number});
+    auto city = find_city(base, row.country_code, row.name);
+    if (city != CityStore::npos) affected[city] = true;
+  }
+  for (auto& line : kept) {
+    auto city = line.line.city;
+    if (city != Dropped && affected[city]) candidates.push_back({line.text, line.number});
+  }
+  sort(candidates.begin(), candidates.end(),
+      [](const Candidate& a, const Candidate& b) { return a.number < b.number; });
+
+  CityStoreBuilder builder;
+  for (auto& line : candidates) {
+    _projection.project(line.text, row);
+    row.line = line.number;
+    builder.add(row);
+  }
+  report_errors(city_file, builder);
+  if (builder.overflowed()) return false;
+  CityStore upserts;
+  upserts.build(builder);
+
+  // Merge the unaffected base cities with the re-picked ones, both already
+  // in (country code, name) order, so the patched store needs no sort.
+  CityStoreBuilder merged;
+  vector<uint32_t> base_remap(base.city_count(), Dropped);
+  uint32_t next = 0;
+
+  CityCursor old_city(base), new_city(upserts);
+  while (!old_city.done() || !new_city.done()) {
+    if (new_city.done() || (!old_city.done() && old_city < new_city)) {
+      if (affected[old_city.city()]) {
+        changes.push_back({CityChange::Deleted,
+            string(old_city.code()), string(old_city.name())});
+      } else {
+        if (!merged.add(old_city.code(), base.city(old_city.city()))) return false;
+        base_remap[old_city.city()] = next++;
+      }
+      old_city.next();
+    } else if (old_city.done() || new_city < old_city) {
+      changes.push_back({CityChange::Inserted,
+          string(new_city.code()), string(new_city.name())});
+      if (!merged.add(new_city.code(), upserts.city(new_city.city()))) return false;
+      next++;
+      new_city.next();
+    } else {
+      auto city = upserts.city(new_city.city());
+      if (!same_values(city, base.city(old_city.city()))) {
+        changes.push_back({CityChange::Updated,
+            string(new_city.code()), string(new_city.name())});
+      }
+      if (!merged.add(new_city.code(), city)) return false;
+      base_remap[old_city.city()] = next++;
+      old_city.next();
+      new_city.next();
+    }
+  }
+  patched.build(merged, true);
+
+  vector<Line> indexed;
+  indexed.reserve(kept.size() + added.size());
+  for (auto& line : kept) {
+    auto city = line.line.city;
+    indexed.push_back({line.line.hash, city == Dropped ? Dropped : base_remap[city]});
+  }
+  for (auto& line : added) {
+    auto id = Dropped;
+    if (_projection.project(line.text, row)) {
+      auto city = find_city(patched, row.country_code, row.name);
+      if (city != CityStore::npos) id = static_cast<uint32_t>(city);
+    }
+    indexed.push_back({line.hash, id});
+  }
+  sort(indexed.begin(), indexed.end(), [](const Line& a, const Line& b) {
+      return a.hash < b.hash;
+    });
+  _lines = move(indexed);
+  return true;
+}
+
+}
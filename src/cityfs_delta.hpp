@@ -0,0 +1,65 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_DELTA_HPP
+#define CITYFS_DELTA_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "cityfs_store.hpp"
+#include "mapped_file.hpp"
+
+namespace cityfs {
+
+  // A city added, changed or removed between two versions of a store.
+  struct CityChange {
+    enum Kind {
+      Inserted,
+      Updated,
+      Deleted
+    };
+
+    Kind kind;
+    std::string country_code;
+    std::string name;
+  };
+
+  typedef std::vector<CityChange> StoreChanges;
+
+  // Hash of every line in a city file and the store city it produced, so
+  // a changed file can be diffed line by line and only its new lines
+  // parsed.  Duplicate lines of a city all map to the city, lines the
+  // format filters out or rejects map to none.
+  class RowIndex {
+    public:
+      explicit RowIndex(const CityFormat& format = CityFormat()):
+        _projection(format) {}
+
+      // Index the lines of a mapped city file against the store built
+      // from those bytes.
+      void build(const MappedFile& file, const CityStore& city_store);
+
+      // Diff city_file against the index and apply the new, changed and
+      // removed rows to base, building patched and re-indexing.  Returns
+      // false if the change can't be applied incrementally and the file
+      // needs a full reload.
+      bool apply(
+          const std::string& city_file,
+          const CityStore& base,
+          CityStore& patched,
+          StoreChanges& changes);
+
+      size_t size() const { return _lines.size(); }
+
+    private:
+      struct Line {
+        uint64_t hash;
+        uint32_t city;
+      };
+
+      RowProjection _projection;
+      std::vector<Line> _lines;
+  };
+}
+
+#endif
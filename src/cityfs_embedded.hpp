@@ -0,0 +1,22 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_EMBEDDED_HPP
+#define CITYFS_EMBEDDED_HPP
+
+#include <cstddef>
+
+namespace cityfs {
+
+  // A city db image compiled into the binary by tools/cityfs_embed.cpp,
+  // when built with -DCITYFS_EMBED_CITIES=city-file.  The image is const
+  // so it's mapped from the executable's read-only pages like code.
+  namespace embedded {
+    extern const char image[];
+    extern const size_t image_size;
+
+    // The city file it was compiled from.
+    extern const char source[];
+  }
+}
+
+#endif
@@ -0,0 +1,90 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_FILTER_HPP
+#define CITYFS_FILTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+namespace cityfs {
+
+  // A blocked Bloom filter: each key sets KeyBits bits of one 64-bit
+  // word, so a query is a hash and a single load.  Names that were never
+  // added are rejected all but ~1% of the time without touching the
+  // strings, which is what most probes for .DS_Store, .git, desktop.ini
+  // and typos are.
+  namespace filter {
+
+    const unsigned KeyBits = 4;
+
+    // Words for count keys, a power of two giving 16 to 32 bits a key.
+    inline size_t words_for(size_t count) {
+      size_t words = 1;
+      while (words * 4 < count) words *= 2;
+      return words;
+    }
+
+    // 8 bytes at a time, then a murmur3 finalizer to spread the bits.
+    // Filters are saved in snapshots, so this mustn't change without a
+    // db::Version bump.
+    inline uint64_t hash(std::string_view key, uint64_t seed = 0) {
+      const uint64_t Multiplier = 0x9e3779b97f4a7c15ull;
+      auto h = seed ^ (key.size() * Multiplier);
+      auto pos = key.data();
+      auto end = pos + key.size();
+      for (; end - pos >= 8; pos += 8) {
+        uint64_t chunk;
+        memcpy(&chunk, pos, sizeof(chunk));
+        h = (h ^ chunk) * Multiplier;
+        h ^= h >> 29;
+      }
+
+      // The last 0-7 bytes with fixed size loads, overlapping from both
+      // ends, the length already being in h.
+      uint64_t tail = 0;
+      auto rest = static_cast<size_t>(end - pos);
+      if (rest >= 4) {
+        uint32_t low, high;
+        memcpy(&low, pos, sizeof(low));
+        memcpy(&high, end - 4, sizeof(high));
+        tail = uint64_t(low) << 32 | high;
+      } else if (rest > 0) {
+        tail = uint64_t(uint8_t(pos[0])) << 16 |
+          uint64_t(uint8_t(pos[rest / 2])) << 8 | uint8_t(pos[rest - 1]);
+      }
+      h = (h ^ tail) * Multiplier;
+
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdull;
+      h ^= h >> 33;
+      h *= 0xc4ceb9fe1a85ec53ull;
+      h ^= h >> 33;
+      return h;
+    }
+
+    // The word is picked by the low bits, the bits in it by the high ones.
+    inline uint64_t key_mask(uint64_t h) {
+      uint64_t mask = 0;
+      for (unsigned i = 1; i <= KeyBits; ++i) {
+        mask |= uint64_t(1) << ((h >> (64 - 6 * i)) & 63);
+      }
+      return mask;
+    }
+
+    inline void add(std::vector<uint64_t>& words, uint64_t h) {
+      words[h & (words.size() - 1)] |= key_mask(h);
+    }
+
+    // False only if h was never added.  An empty filter passes everything.
+    inline bool may_contain(const uint64_t* words, size_t count, uint64_t h) {
+      if (count == 0) return true;
+      auto mask = key_mask(h);
+      return (words[h & (count - 1)] & mask) == mask;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,135 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_FLAT_HPP
+#define CITYFS_FLAT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace cityfs {
+
+  // An open-addressing hash index, SwissTable style: one control byte a
+  // slot holding 7 bits of the key's hash, or Empty, probed a group of
+  // 16 at a time.  It maps hashes to the caller's own indexes, eg, into
+  // a vector of the keys, and the caller checks candidates against the
+  // key, so strings are stored once and compared only on a 7 bit match.
+  // Nothing is ever erased.  The tables can be saved and probed in place,
+  // eg, from a mapped store image.
+  class FlatIndex {
+    public:
+      static constexpr uint32_t npos = ~uint32_t(0);
+      static constexpr size_t GroupSize = 16;
+
+      FlatIndex() { reset(GroupSize); }
+
+      // The index of the key with hash h that is(index) says is the one,
+      // or npos.
+      template <typename Is>
+        uint32_t find(uint64_t h, Is is) const {
+          return find(_control.data(), _indexes.data(), _control.size(), h, is);
+        }
+
+      // find() over saved tables of slots entries, a power of two
+      // multiple of GroupSize.
+      template <typename Is>
+        static uint32_t find(const int8_t* control, const uint32_t* indexes,
+            size_t slots, uint64_t h, Is is) {
+          auto tag = static_cast<int8_t>(h & 0x7f);
+          auto group_mask = slots / GroupSize - 1;
+          for (auto group = (h >> 7) & group_mask;; group = (group + 1) & group_mask) {
+            auto base = group * GroupSize;
+            auto matches = match(control + base, tag);
+            while (matches != 0) {
+              auto slot = base + static_cast<size_t>(__builtin_ctz(matches));
+              if (is(indexes[slot])) return indexes[slot];
+              matches &= matches - 1;
+            }
+            if (match(control + base, Empty) != 0) return npos;
+          }
+        }
+
+      // True if slots is a table size find() can probe.
+      static bool valid_slots(uint64_t slots) {
+        return slots >= GroupSize && (slots & (slots - 1)) == 0;
+      }
+
+      // Add index under h, growing once 7/8 full.
+      void insert(uint64_t h, uint32_t index) {
+        if ((_size + 1) * 8 > _control.size() * 7) grow();
+        place(h, index);
+        ++_size;
+      }
+
+      size_t size() const { return _size; }
+
+      // The tables to save, both slots() long.
+      size_t slots() const { return _control.size(); }
+      const int8_t* control() const { return _control.data(); }
+      const uint32_t* indexes() const { return _indexes.data(); }
+
+    private:
+      static constexpr int8_t Empty = -128;
+
+      size_t first_group(uint64_t h) const {
+        return static_cast<size_t>(h >> 7) & _group_mask;
+      }
+
+      // Bit i set if control byte i of the group is tag.
+      static uint32_t match(const int8_t* group, int8_t tag) {
+#if defined(__SSE2__)
+        auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(tag))));
+#else
+        uint32_t bits = 0;
+        for (size_t i = 0; i < GroupSize; ++i) {
+          bits |= uint32_t(group[i] == tag) << i;
+        }
+        return bits;
+#endif
+      }
+
+      void place(uint64_t h, uint32_t index) {
+        for (auto group = first_group(h);; group = (group + 1) & _group_mask) {
+          auto base = group * GroupSize;
+          auto empty = match(_control.data() + base, Empty);
+          if (empty != 0) {
+            auto slot = base + static_cast<size_t>(__builtin_ctz(empty));
+            _control[slot] = static_cast<int8_t>(h & 0x7f);
+            _hashes[slot] = h;
+            _indexes[slot] = index;
+            return;
+          }
+        }
+      }
+
+      void reset(size_t slots) {
+        _control.assign(slots, Empty);
+        _hashes.assign(slots, 0);
+        _indexes.assign(slots, npos);
+        _group_mask = slots / GroupSize - 1;
+      }
+
+      void grow() {
+        auto control = std::move(_control);
+        auto hashes = std::move(_hashes);
+        auto indexes = std::move(_indexes);
+        reset(control.size() * 2);
+        for (size_t slot = 0; slot < control.size(); ++slot) {
+          if (control[slot] != Empty) place(hashes[slot], indexes[slot]);
+        }
+      }
+
+      std::vector<int8_t> _control;
+      std::vector<uint64_t> _hashes;
+      std::vector<uint32_t> _indexes;
+      size_t _group_mask = 0;
+      size_t _size = 0;
+  };
+}
+
+#endif
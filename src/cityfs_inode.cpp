@@ -0,0 +1,175 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#include "cityfs_inode.hpp"
+
+namespace cityfs {
+
+using namespace std;
+
+InodeTable::Cities InodeTable::current() {
+  lock_guard<mutex> lock(_mutex);
+  return latest();
+}
+
+// The latest generation, taking in what's been published since.  Called
+// locked.
+const InodeTable::Cities& InodeTable::latest() {
+  CityStorePtr store;
+  LazyCityStorePtr lazy_store;
+  if (_lazy_stores) {
+    lazy_store = _lazy_stores->current();
+  } else {
+    store = _stores->current();
+  }
+
+  if (!_generations.empty()) {
+    auto& latest = _generations.back().cities;
+    if (latest.store == store && latest.lazy_store == lazy_store) return latest;
+    if (store && _patch.cities.store == store && _patch.base == latest.store) {
+      latest = move(_patch.cities);
+      _patch = Patch();
+      return latest;
+    }
+  }
+  _patch = Patch();
+
+  // The kernel may still hold inodes of a generation the ids wrapped
+  // around to.
+  auto id = _next;
+  for (unsigned tried = 0; tried < inode::Generations && find(id); ++tried) {
+    id = (id + 1) % inode::Generations;
+  }
+  Generation generation;
+  generation.cities.generation = id;
+  generation.cities.store = move(store);
+  generation.cities.lazy_store = move(lazy_store);
+  _next = (id + 1) % inode::Generations;
+  _generations.push_back(move(generation));
+  prune();
+  return _generations.back().cities;
+}
+
+void InodeTable::patch(const CityStorePtr& base, const CityStorePtr& patched) {
+  Cities cities;
+  {
+    lock_guard<mutex> lock(_mutex);
+    cities = latest();
+    if (!base || cities.store != base) return;
+  }
+
+  // Mapped outside the lock, requests carry on with base meanwhile.
+  auto ids = make_shared<InodeIds>();
+  if (!remap(cities, *patched, *ids)) return;
+  cities.store = patched;
+  cities.ids = move(ids);
+
+  lock_guard<mutex> lock(_mutex);
+  _patch.base = base;
+  _patch.cities = move(cities);
+}
+
+// The ids of cities, carried over to patched by country code and city
+// name, both stores being in that order.  False if they run out.
+bool InodeTable::remap(const Cities& cities, const CityStore& patched, InodeIds& ids) {
+  auto& base = *cities.store;
+  auto old_ids = cities.ids.get();
+  ids.countries.assign(old_ids ? old_ids->countries.size() : base.country_count(),
+      InodeIds::None);
+  ids.cities.assign(old_ids ? old_ids->cities.size() : base.city_count(), InodeIds::None);
+  ids.country_ids.resize(patched.country_count());
+  ids.city_ids.resize(patched.city_count());
+
+  // The id of a base index, or a new one.
+  auto country_id = [&](size_t base_country) -> uint32_t {
+    if (base_country == CityStore::npos) {
+      ids.countries.push_back(InodeIds::None);
+      return static_cast<uint32_t>(ids.countries.size() - 1);
+    }
+    return static_cast<uint32_t>(old_ids ? old_ids->country_ids[base_country] : base_country);
+  };
+  auto city_id = [&](size_t base_city) -> uint32_t {
+    if (base_city == CityStore::npos) {
+      ids.cities.push_back(InodeIds::None);
+      return static_cast<uint32_t>(ids.cities.size() - 1);
+    }
+    return static_cast<uint32_t>(old_ids ? old_ids->city_ids[base_city] : base_city);
+  };
+
+  for (size_t country = 0; country < patched.country_count(); ++country) {
+    auto base_country = base.find_country(patched.country_code(country));
+    auto id = country_id(base_country);
+    ids.country_ids[country] = id;
+    ids.countries[id] = static_cast<uint32_t>(country);
+
+    auto old_city = base_country == CityStore::npos ? 0 : base.city_begin(base_country);
+    auto old_end = base_country == CityStore::npos ? 0 : base.city_end(base_country);
+    for (auto city = patched.city_begin(country); city < patched.city_end(country); ++city) {
+      auto name = patched.city_name(city);
+      while (old_city < old_end && base.city_name(old_city) < name) ++old_city;
+      auto same = old_city < old_end && base.city_name(old_city) == name;
+      auto id = city_id(same ? old_city++ : CityStore::npos);
+      ids.city_ids[city] = id;
+      ids.cities[id] = static_cast<uint32_t>(city);
+    }
+  }
+  return ids.countries.size() <= 0x10000 && ids.cities.size() < InodeIds::None;
+}
+
+InodeTable::Generation* InodeTable::find(unsigned generation) {
+  for (auto& candidate : _generations) {
+    if (candidate.cities.generation == generation) return &candidate;
+  }
+  return nullptr;
+}
+
+bool InodeTable::find(uint64_t ino, Cities& cities) {
+  lock_guard<mutex> lock(_mutex);
+  latest();
+  auto generation = find(inode::generation(ino));
+  if (generation == nullptr) return false;
+  cities = generation->cities;
+  return true;
+}
+
+void InodeTable::lookup(const Cities& cities, uint64_t ino) {
+  if (inode::kind(ino) == inode::Fixed) return;
+  lock_guard<mutex> lock(_mutex);
+  auto generation = find(cities.generation);
+  if (generation) {
+    ++generation->lookups;
+    return;
+  }
+  // Behind the latest, which stays last.
+  Generation pruned;
+  pruned.cities = cities;
+  pruned.lookups = 1;
+  _generations.insert(_generations.end() - (_generations.empty() ? 0 : 1), move(pruned));
+}
+
+void InodeTable::forget(uint64_t ino, uint64_t nlookup) {
+  if (inode::kind(ino) == inode::Fixed) return;
+  lock_guard<mutex> lock(_mutex);
+  auto generation = find(inode::generation(ino));
+  if (generation == nullptr) return;
+  generation->lookups -= min(nlookup, generation->lookups);
+  prune();
+}
+
+// Drop the old generations the kernel is done with.  Those it still
+// has inodes of are kept however many there are.
+void InodeTable::prune() {
+  for (size_t i = 0; i + 1 < _generations.size();) {
+    if (_generations[i].lookups == 0) {
+      _generations.erase(_generations.begin() + i);
+    } else {
+      ++i;
+    }
+  }
+}
+
+size_t InodeTable::generation_count() const {
+  lock_guard<mutex> lock(_mutex);
+  return _generations.size();
+}
+
+}
@@ -0,0 +1,153 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_INODE_HPP
+#define CITYFS_INODE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "cityfs_reload.hpp"
+
+namespace cityfs {
+
+  // Inode numbers for the low-level FUSE backend, derived from store
+  // indexes so no table maps them back.  The top two bits are the kind,
+  // then 14 bits of the store's generation, the country index and, for
+  // cities, the city index in the store the country's cities come from.
+  // Those are the indexes of the store the generation was published with,
+  // see InodeIds for patches.
+  namespace inode {
+
+    enum Kind {
+      Fixed,
+      Country,
+      City
+    };
+
+    const uint64_t Root = 1;
+    const uint64_t StatusDir = 2;
+    const uint64_t Ready = 3;
+
+    const unsigned GenerationBits = 14;
+    const unsigned Generations = 1u << GenerationBits;
+
+    inline Kind kind(uint64_t ino) { return static_cast<Kind>(ino >> 62); }
+    inline unsigned generation(uint64_t ino) {
+      return static_cast<unsigned>(ino >> 48) & (Generations - 1);
+    }
+    inline size_t country(uint64_t ino) { return static_cast<size_t>((ino >> 32) & 0xffff); }
+    inline size_t city(uint64_t ino) { return static_cast<size_t>(ino & 0xffffffff); }
+
+    inline uint64_t country_inode(unsigned generation, size_t country) {
+      return uint64_t(Country) << 62 | uint64_t(generation) << 48 | uint64_t(country) << 32;
+    }
+    inline uint64_t city_inode(unsigned generation, size_t country, size_t city) {
+      return uint64_t(City) << 62 | uint64_t(generation) << 48 |
+        uint64_t(country) << 32 | uint64_t(city);
+    }
+  }
+
+  // A generation's inode ids mapped to the indexes of a store patched
+  // from the one it was published with, and back.  Cities and countries
+  // removed map to None, those added get new ids.
+  struct InodeIds {
+    static constexpr uint32_t None = ~uint32_t(0);
+
+    std::vector<uint32_t> countries;
+    std::vector<uint32_t> country_ids;
+    std::vector<uint32_t> cities;
+    std::vector<uint32_t> city_ids;
+  };
+
+  // The stores behind the inodes handed to the kernel.  Each store
+  // loaded gets a generation, kept alive while the kernel still has
+  // lookups of its inodes outstanding, so an inode keeps naming the city
+  // it was looked up as across reloads.  A store patched from the latest
+  // one takes over its generation, its inodes naming the same cities.
+  class InodeTable {
+    public:
+      struct Cities {
+        unsigned generation = 0;
+        CityStorePtr store;
+        LazyCityStorePtr lazy_store;
+        // Set once patched.
+        std::shared_ptr<const InodeIds> ids;
+
+        // The store's country or city for an inode's id, npos if it was
+        // removed.
+        size_t country(size_t id) const {
+          return ids ? index(ids->countries, id) : id;
+        }
+        size_t city(size_t id) const {
+          return ids ? index(ids->cities, id) : id;
+        }
+
+        uint64_t country_inode(size_t country) const {
+          return inode::country_inode(generation, ids ? ids->country_ids[country] : country);
+        }
+        uint64_t city_inode(size_t country, size_t city) const {
+          return inode::city_inode(generation, ids ? ids->country_ids[country] : country,
+              ids ? ids->city_ids[city] : city);
+        }
+
+        private:
+          static size_t index(const std::vector<uint32_t>& indexes, size_t id) {
+            return id < indexes.size() && indexes[id] != InodeIds::None ?
+              indexes[id] : CityStore::npos;
+          }
+      };
+
+      explicit InodeTable(const CityStoreRef& stores): _stores(&stores) {}
+      explicit InodeTable(const LazyCityStoreRef& stores): _lazy_stores(&stores) {}
+
+      // The current cities, given a new generation if they've been
+      // loaded since the last call.
+      Cities current();
+
+      // The cities of ino's generation, false if they're gone.
+      bool find(uint64_t ino, Cities& cities);
+
+      // Before patched, changed from base, is published, so it can keep
+      // base's generation if that's the latest.  It gets a new one if its
+      // ids run out.
+      void patch(const CityStorePtr& base, const CityStorePtr& patched);
+
+      // Count an entry of cities about to be replied to the kernel, and
+      // the kernel forgetting nlookup of them.  Cities pruned since they
+      // were handed out get their generation back, so it's held from
+      // before the reply.
+      void lookup(const Cities& cities, uint64_t ino);
+      void forget(uint64_t ino, uint64_t nlookup);
+
+      size_t generation_count() const;
+
+    private:
+      struct Generation {
+        Cities cities;
+        uint64_t lookups = 0;
+      };
+
+      struct Patch {
+        CityStorePtr base;
+        Cities cities;
+      };
+
+      const Cities& latest();
+      Generation* find(unsigned generation);
+      void prune();
+      static bool remap(const Cities& cities, const CityStore& patched, InodeIds& ids);
+
+      const CityStoreRef* _stores = nullptr;
+      const LazyCityStoreRef* _lazy_stores = nullptr;
+
+      mutable std::mutex _mutex;
+      std::deque<Generation> _generations;
+      Patch _patch;
+      unsigned _next = 0;
+  };
+}
+
+#endif
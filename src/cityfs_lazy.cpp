@@ -0,0 +1,236 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#include "cityfs_lazy.hpp"
+#include "cityfs_csv.hpp"
+#include "cityfs_decompress.hpp"
+#include "cityfs_filter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+namespace cityfs {
+
+using namespace std;
+
+static const char* IndexMagic = "cityfs-index";
+static const unsigned IndexVersion = 4;
+
+string LazyCityStore::index_path(const string& path, const string& index_dir) {
+  if (index_dir.empty()) return path + ".cfsidx";
+  auto name = path;
+  replace(name.begin(), name.end(), '/', '%');
+  return index_dir + "/" + name + ".cfsidx";
+}
+
+bool LazyCityStore::open(const string& path, const LoadOptions& options, LoadStats* stats) {
+  auto start = chrono::steady_clock::now();
+  _path = path;
+  _format = options.format;
+
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || !_file.open(path)) {
+    cerr << "Error opening " << path << endl;
+    return false;
+  }
+  if (compression_of(_file.data(), _file.size()) != Compression::None) {
+    cerr << "Error: " << path << " is compressed, lazy loading needs the offsets of its rows" << endl;
+    return false;
+  }
+  _file_mtime = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ull +
+    static_cast<uint64_t>(st.st_mtim.tv_nsec);
+  _countries.clear();
+  _codes = FlatIndex();
+
+  auto index_file = index_path(path, options.index_dir);
+  auto indexed = read_index(index_file);
+  if (!indexed) {
+    _countries.clear();
+    _codes = FlatIndex();
+    scan();
+    if (!write_index(index_file)) {
+      cerr << "Couldn't write " << index_file << ", the next mount will scan again" << endl;
+    }
+  }
+
+  sort(_countries.begin(), _countries.end(),
+      [](const unique_ptr<Country>& a, const unique_ptr<Country>& b) {
+        return a->code < b->code;
+      });
+  _codes = FlatIndex();
+
+  // Nothing's parsed yet, bytes is what the pre-scan read.
+  if (stats) {
+    stats->rows = 0;
+    stats->bytes = indexed ? 0 : _file.size();
+    stats->threads = 1;
+    stats->seconds = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+  }
+  return true;
+}
+
+LazyCityStore::Country& LazyCityStore::country_for(string_view code) {
+  auto h = filter::hash(code);
+  auto found = _codes.find(h, [this, code](uint32_t country) {
+      return _countries[country]->code == code;
+    });
+  if (found != FlatIndex::npos) return *_countries[found];
+  _countries.emplace_back(new Country());
+  _countries.back()->code = string(code);
+  _codes.insert(h, static_cast<uint32_t>(_countries.size() - 1));
+  return *_countries.back();
+}
+
+// A range starting where the country's last one ends, but for line
+// endings, extends it.
+void LazyCityStore::add_range(string_view code, const Range& range) {
+  auto& ranges = country_for(code).ranges;
+  if (!ranges.empty() && ranges.back().end <= range.begin) {
+    auto gap = _file.data() + ranges.back().end;
+    auto begin = _file.data() + range.begin;
+    if (all_of(gap, begin, [](char c) { return c == '\n' || c == '\r'; })) {
+      ranges.back().end = range.end;
+      return;
+    }
+  }
+  ranges.push_back(range);
+}
+
+// Only the country code of each line is read, and the columns the
+// format's filters need, so countries whose rows are all filtered out
+// aren't listed.  Files are usually grouped by country, so consecutive
+// lines of a country share one range.
+void LazyCityStore::scan() {
+  CityFormat codes;
+  codes.delimiter = _format.delimiter;
+  codes.quoted = _format.quoted;
+  codes.feature_classes = _format.feature_classes;
+  codes.min_population = _format.min_population;
+  fill(codes.columns, codes.columns + CityFormat::FieldCount, CityFormat::NoColumn);
+  codes.columns[CityFormat::CountryCode] = _format.columns[CityFormat::CountryCode];
+  if (!codes.feature_classes.empty()) {
+    codes.columns[CityFormat::FeatureClass] = _format.columns[CityFormat::FeatureClass];
+  }
+  if (codes.min_population > 0) {
+    codes.columns[CityFormat::Population] = _format.columns[CityFormat::Population];
+  }
+  RowProjection projection(codes);
+
+  auto data = _file.data();
+  auto counted = data;
+  uint64_t number = 1;
+  CityRow row;
+  for_each_line(data, _file.end(), [&](string_view line) {
+      number += static_cast<uint64_t>(count(counted, line.data(), '\n'));
+      counted = line.data();
+      if (!projection.project(line, row) || row.country_code.empty()) return;
+
+      uint64_t begin = static_cast<uint64_t>(line.data() - data);
+      add_range(row.country_code, {begin, begin + line.size(), number});
+    });
+}
+
+size_t LazyCityStore::find_country(string_view code) const {
+  auto it = lower_bound(_countries.begin(), _countries.end(), code,
+      [](const unique_ptr<Country>& country, string_view code) {
+        return country->code < code;
+      });
+  if (it == _countries.end() || (*it)->code != code) return CityStore::npos;
+  return static_cast<size_t>(it - _countries.begin());
+}
+
+shared_ptr<const CityStore> LazyCityStore::country(size_t country) const {
+  auto& entry = *_countries[country];
+  call_once(entry.parsed, [&]() {
+      RowProjection projection(_format);
+      CityStoreBuilder builder;
+      for (auto& range : entry.ranges) {
+        auto begin = _file.data() + range.begin;
+        size_t line = range.line;
+        scan_city_rows(begin, _file.data() + range.end, projection,
+            [&](const CityRow& row) {
+              builder.add(row);
+            }, &line);
+      }
+      report_errors(_path, builder);
+      auto store = make_shared<CityStore>();
+      store->build(builder);
+      atomic_store(&entry.store, shared_ptr<const CityStore>(move(store)));
+      _parsed.fetch_add(1);
+    });
+  return atomic_load(&entry.store);
+}
+
+shared_ptr<const CityStore> LazyCityStore::parsed(size_t country) const {
+  return atomic_load(&_countries[country]->store);
+}
+
+// The format settings the scan read the file with, as the sidecar
+// header records them.
+static string scan_settings(const CityFormat& format) {
+  return to_string(static_cast<unsigned char>(format.delimiter)) + " " +
+    to_string(format.quoted) + " " +
+    to_string(format.columns[CityFormat::CountryCode]) + " " +
+    to_string(format.columns[CityFormat::FeatureClass]) + " " +
+    (format.feature_classes.empty() ? string("-") : format.feature_classes) + " " +
+    to_string(format.columns[CityFormat::Population]) + " " +
+    to_string(format.min_population);
+}
+
+// The sidecar is text, one range per line after a header recording the
+// size and modification time of the file it indexes, and how its rows
+// were scanned.  Each range is its country code, byte offsets and first
+// line number.
+bool LazyCityStore::read_index(const string& path) {
+  ifstream in(path);
+  if (!in) return false;
+
+  string magic, settings;
+  unsigned version = 0;
+  uint64_t size = 0, mtime = 0;
+  in >> magic >> version >> size >> mtime >> ws;
+  getline(in, settings);
+  if (!in || magic != IndexMagic || version != IndexVersion ||
+      size != _file.size() || mtime != _file_mtime ||
+      settings != scan_settings(_format)) {
+    return false;
+  }
+
+  string code;
+  Range range;
+  while (in >> code >> range.begin >> range.end >> range.line) {
+    if (range.begin > range.end || range.end > _file.size()) {
+      _countries.clear();
+      return false;
+    }
+    add_range(code, range);
+  }
+  return in.eof();
+}
+
+bool LazyCityStore::write_index(const string& path) const {
+  auto temp_path = path + ".tmp";
+  {
+    ofstream out(temp_path, ios::trunc);
+    if (!out) return false;
+    out << IndexMagic << " " << IndexVersion << " "
+      << _file.size() << " " << _file_mtime << " "
+      << scan_settings(_format) << "\n";
+    for (auto& country : _countries) {
+      for (auto& range : country->ranges) {
+        out << country->code << " " << range.begin << " " << range.end << " "
+          << range.line << "\n";
+      }
+    }
+    if (!out.flush()) {
+      remove(temp_path.c_str());
+      return false;
+    }
+  }
+  return rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+}
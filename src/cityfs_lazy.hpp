@@ -0,0 +1,92 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_LAZY_HPP
+#define CITYFS_LAZY_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cityfs.hpp"
+#include "cityfs_flat.hpp"
+#include "cityfs_store.hpp"
+#include "mapped_file.hpp"
+
+namespace cityfs {
+
+  // A city file opened without parsing it.  Only the byte ranges of each
+  // country's rows are indexed up front, from a pre-scan of the country
+  // codes or an up to date <city-file>.cfsidx sidecar, and a country's
+  // store is parsed the first time it's asked for.  The sidecar is kept
+  // next to the city file unless LoadOptions::index_dir says otherwise.
+  //
+  // The file stays mapped, so replace it by renaming rather than
+  // rewriting it in place.
+  class LazyCityStore {
+    public:
+      bool open(
+          const std::string& path,
+          const LoadOptions& options = LoadOptions(),
+          LoadStats* stats = nullptr);
+
+      size_t country_count() const { return _countries.size(); }
+      std::string_view country_code(size_t country) const {
+        return _countries[country]->code;
+      }
+
+      // Binary search, returning CityStore::npos if missing.
+      size_t find_country(std::string_view code) const;
+
+      // The country's cities, parsed on first use.  Safe to call from
+      // several threads.
+      std::shared_ptr<const CityStore> country(size_t country) const;
+
+      // The country's cities if they've been parsed already, else null.
+      std::shared_ptr<const CityStore> parsed(size_t country) const;
+
+      // Countries parsed so far.
+      size_t parsed_count() const { return _parsed.load(); }
+
+      // The sidecar of path, in index_dir if it's set, named for the
+      // whole path with '/' as '%' so files of the same name don't share
+      // one.
+      static std::string index_path(const std::string& path,
+          const std::string& index_dir = std::string());
+
+    private:
+      // Bytes [begin, end) of the file, starting on line number line, so
+      // bad rows are reported where they are.
+      struct Range {
+        uint64_t begin;
+        uint64_t end;
+        uint64_t line;
+      };
+
+      struct Country {
+        std::string code;
+        std::vector<Range> ranges;
+        mutable std::once_flag parsed;
+        mutable std::shared_ptr<const CityStore> store;
+      };
+
+      void scan();
+      Country& country_for(std::string_view code);
+      void add_range(std::string_view code, const Range& range);
+      bool read_index(const std::string& path);
+      bool write_index(const std::string& path) const;
+
+      std::string _path;
+      CityFormat _format;
+      MappedFile _file;
+      uint64_t _file_mtime = 0;
+      std::vector<std::unique_ptr<Country>> _countries;
+      // Countries by code while they're indexed, before they're sorted.
+      FlatIndex _codes;
+      mutable std::atomic<size_t> _parsed{0};
+  };
+}
+
+#endif
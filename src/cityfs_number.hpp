@@ -0,0 +1,82 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_NUMBER_HPP
+#define CITYFS_NUMBER_HPP
+
+#include <cstdint>
+#include <string_view>
+
+namespace cityfs {
+
+  // Coordinates are fixed-point in units of 1e-5 degrees (~1m), the
+  // precision GeoNames publishes.
+  const int32_t CoordinateScale = 100000;
+  const int CoordinateDigits = 5;
+
+  inline bool is_digit(char c) {
+    return static_cast<unsigned>(c - '0') < 10;
+  }
+
+  // Parse [-+]digits[.digits] in degrees straight into fixed-point,
+  // rounding half away from zero at the sixth decimal.  No doubles and no
+  // locale, so 12.345675 rounds the same everywhere.
+  inline bool parse_coordinate(std::string_view text, int32_t& value) {
+    auto pos = text.data();
+    auto end = pos + text.size();
+
+    bool negative = false;
+    if (pos < end && (*pos == '-' || *pos == '+')) {
+      negative = *pos == '-';
+      ++pos;
+    }
+
+    uint32_t whole = 0;
+    auto whole_begin = pos;
+    for (; pos < end && is_digit(*pos); ++pos) {
+      whole = whole * 10 + static_cast<uint32_t>(*pos - '0');
+      if (whole > 180) return false;
+    }
+    bool digits = pos > whole_begin;
+
+    uint32_t fraction = 0;
+    int fraction_digits = 0;
+    bool round_up = false;
+    if (pos < end && *pos == '.') {
+      auto fraction_begin = ++pos;
+      for (; pos < end && is_digit(*pos); ++pos) {
+        if (fraction_digits < CoordinateDigits) {
+          fraction = fraction * 10 + static_cast<uint32_t>(*pos - '0');
+          ++fraction_digits;
+        } else if (fraction_digits == CoordinateDigits) {
+          round_up = *pos >= '5';
+          ++fraction_digits;
+        }
+      }
+      digits = digits || pos > fraction_begin;
+    }
+    if (!digits || pos != end) return false;
+
+    for (; fraction_digits < CoordinateDigits; ++fraction_digits) {
+      fraction *= 10;
+    }
+    auto scaled = whole * static_cast<uint32_t>(CoordinateScale) + fraction + round_up;
+    if (scaled > 180u * CoordinateScale) return false;
+
+    value = negative ? -static_cast<int32_t>(scaled) : static_cast<int32_t>(scaled);
+    return true;
+  }
+
+  // Parse an unsigned decimal, an empty field being 0.
+  inline bool parse_population(std::string_view text, uint32_t& value) {
+    uint64_t population = 0;
+    for (auto c : text) {
+      if (!is_digit(c)) return false;
+      population = population * 10 + static_cast<uint64_t>(c - '0');
+      if (population > UINT32_MAX) return false;
+    }
+    value = static_cast<uint32_t>(population);
+    return true;
+  }
+}
+
+#endif
@@ -0,0 +1,279 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#include "cityfs_radix.hpp"
+#include "cityfs_store.hpp"
+#include <algorithm>
+#include <iterator>
+
+namespace cityfs {
+
+using namespace std;
+
+PathIndex::PathIndex(const CityStore& city_store):
+  _countries(city_store.country_count(), NoNode) {
+  Keys keys;
+  keys.reserve(1 + 2 * city_store.country_count() + city_store.city_count());
+  PathNode root;
+  root.kind = PathNode::Root;
+  keys.push_back({"/", root, false});
+  for (size_t country = 0; country < city_store.country_count(); ++country) {
+    auto directory = add_country(city_store, country, keys);
+    if (directory.empty()) continue;
+    for (auto city = city_store.city_begin(country); city < city_store.city_end(country); ++city) {
+      add_city(city_store, country, city, directory, keys);
+    }
+  }
+
+  stable_sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) {
+      return a.path < b.path;
+    });
+  build(keys);
+}
+
+// previous's paths are already in order, with their countries ahead of
+// their cities.  Countries new to city_store, the inserted cities, and
+// the codes, which aren't listed, are keyed and merged in.
+PathIndex::PathIndex(const PathIndex& previous, const CityStore& city_store,
+    const StoreChanges& changes):
+  _countries(city_store.country_count(), NoNode) {
+  Keys keys;
+  keys.reserve(previous._size + changes.size());
+  vector<size_t> countries(previous._countries.size(), CityStore::npos);
+  previous.for_each("/", [&](string_view path, const PathNode& node) {
+      auto value = node;
+      if (node.kind == PathNode::Country) {
+        value.country = city_store.find_country(path_to_country(path.substr(1)));
+        countries[node.country] = value.country;
+        if (value.country == CityStore::npos) return false;
+      } else if (node.kind == PathNode::City) {
+        value.country = countries[node.country];
+        value.city = city_store.find_city(value.country, path.substr(path.rfind('/') + 1));
+        if (value.city == CityStore::npos) return true;
+      }
+      keys.push_back({string(path), value, false});
+      return true;
+    });
+
+  Keys added;
+  vector<bool> carried(city_store.country_count());
+  for (auto country : countries) {
+    if (country != CityStore::npos) carried[country] = true;
+  }
+  vector<string> directories(city_store.country_count());
+  for (size_t country = 0; country < city_store.country_count(); ++country) {
+    auto& directory = directories[country];
+    directory = add_country(city_store, country, added);
+    if (directory.empty() || carried[country]) continue;
+    for (auto city = city_store.city_begin(country); city < city_store.city_end(country); ++city) {
+      add_city(city_store, country, city, directory, added);
+    }
+  }
+  for (auto& change : changes) {
+    if (change.kind != CityChange::Inserted) continue;
+    auto country = city_store.find_country(change.country_code);
+    if (country == CityStore::npos || !carried[country] || directories[country].empty()) {
+      continue;
+    }
+    auto city = city_store.find_city(country, change.name);
+    if (city != CityStore::npos) add_city(city_store, country, city, directories[country], added);
+  }
+
+  auto by_path = [](const Key& a, const Key& b) { return a.path < b.path; };
+  stable_sort(added.begin(), added.end(), by_path);
+  Keys merged;
+  merged.reserve(keys.size() + added.size());
+  merge(make_move_iterator(keys.begin()), make_move_iterator(keys.end()),
+      make_move_iterator(added.begin()), make_move_iterator(added.end()),
+      back_inserter(merged), by_path);
+  build(merged);
+}
+
+// Key country by name and by code, where they resolve to it.  The
+// first is the directory its cities go under, empty if neither does.
+string PathIndex::add_country(const CityStore& city_store, size_t country, Keys& keys) {
+  PathNode node;
+  node.kind = PathNode::Country;
+  node.country = country;
+  auto code = city_store.country_code(country);
+  string directory;
+  for (auto name : {country_to_path(code), code}) {
+    if (name.find('/') != string_view::npos ||
+        city_store.find_country(path_to_country(name)) != country) {
+      continue;
+    }
+    if (directory.empty()) {
+      directory = "/" + string(name);
+      keys.push_back({directory, node, false});
+    } else if (directory.compare(1, string::npos, name) != 0) {
+      keys.push_back({"/" + string(name), node, true});
+    }
+  }
+  return directory;
+}
+
+void PathIndex::add_city(const CityStore& city_store, size_t country, size_t city,
+    const string& directory, Keys& keys) {
+  auto name = city_store.city_name(city);
+  if (name.find('/') != string_view::npos) return;
+  PathNode node;
+  node.kind = PathNode::City;
+  node.country = country;
+  node.city = city_store.find_city(country, name);
+  keys.push_back({directory + "/" + string(name), node, false});
+}
+
+// Build the tree over sorted keys.  Cities sharing a name resolve to the
+// same one, and a carried key comes before the same one keyed again.
+void PathIndex::build(Keys& keys) {
+  keys.erase(unique(keys.begin(), keys.end(), [](const Key& a, const Key& b) {
+      return a.path == b.path;
+    }), keys.end());
+
+  _size = keys.size();
+  _nodes.resize(1);
+  build(keys, 0, keys.size(), 0, 0);
+}
+
+// Build node over keys [begin, end), which share their first depth bytes.
+// Sorted, the range's common prefix is that of its first and last keys.
+void PathIndex::build(const Keys& keys, size_t begin, size_t end, size_t depth, uint32_t node) {
+  auto& first = keys[begin].path;
+  auto& last = keys[end - 1].path;
+  auto common = depth;
+  while (common < first.size() && common < last.size() && first[common] == last[common]) {
+    ++common;
+  }
+
+  Node built;
+  built.label_offset = static_cast<uint32_t>(_labels.size());
+  built.label_length = static_cast<uint32_t>(common - depth);
+  built.first_byte = common > depth ? static_cast<uint8_t>(first[depth]) : 0;
+  built.kind = PathNode::Missing;
+  built.country = 0;
+  built.city = 0;
+  built.alias = 0;
+  _labels.append(first, depth, common - depth);
+  if (first.size() == common) {
+    auto& key = keys[begin++];
+    auto& value = key.node;
+    built.kind = static_cast<uint8_t>(value.kind);
+    built.country = static_cast<uint16_t>(value.kind == PathNode::Root ? 0 : value.country);
+    built.city = static_cast<uint32_t>(value.kind == PathNode::City ? value.city : 0);
+    built.alias = key.alias;
+    if (value.kind == PathNode::Country && !key.alias) _countries[value.country] = node;
+  }
+
+  // One child per distinct next byte, allocated together.
+  auto next = [&keys, common, end](size_t key) {
+    auto byte = keys[key].path[common];
+    while (++key < end && keys[key].path[common] == byte) {}
+    return key;
+  };
+  uint16_t children = 0;
+  for (auto key = begin; key < end; key = next(key)) ++children;
+  built.first_child = static_cast<uint32_t>(_nodes.size());
+  built.child_count = children;
+  _nodes[node] = built;
+  _nodes.resize(_nodes.size() + children);
+
+  auto child = built.first_child;
+  for (auto key = begin; key < end; ++child) {
+    auto group_end = next(key);
+    build(keys, key, group_end, common, child);
+    key = group_end;
+  }
+}
+
+PathNode PathIndex::value(const Node& node) {
+  PathNode value;
+  value.kind = static_cast<PathNode::Kind>(node.kind);
+  if (value.kind == PathNode::Country || value.kind == PathNode::City) {
+    value.country = node.country;
+  }
+  if (value.kind == PathNode::City) value.city = node.city;
+  return value;
+}
+
+const PathIndex::Node* PathIndex::child(const Node& node, uint8_t byte) const {
+  auto first = _nodes.data() + node.first_child;
+  auto last = first + node.child_count;
+  auto iter = lower_bound(first, last, byte, [](const Node& child, uint8_t byte) {
+      return child.first_byte < byte;
+    });
+  return iter != last && iter->first_byte == byte ? iter : nullptr;
+}
+
+// Follow key down from node, whose label's first matched bytes are
+// behind it already.  False if key leaves the tree.
+bool PathIndex::walk(const Node*& node, size_t& matched, string_view key) const {
+  while (!key.empty()) {
+    if (matched == node->label_length) {
+      node = child(*node, static_cast<uint8_t>(key[0]));
+      if (node == nullptr) return false;
+      matched = 0;
+    }
+    auto text = label(*node).substr(matched, key.size());
+    if (key.substr(0, text.size()) != text) return false;
+    matched += text.size();
+    key.remove_prefix(text.size());
+  }
+  return true;
+}
+
+// The country directory first, then the city from under the country's
+// name whichever spelling path used.
+PathNode PathIndex::find(string_view path) const {
+  if (path.empty() || path[0] != '/') return PathNode();
+  auto slash = path.find('/', 1);
+  auto node = _nodes.data();
+  size_t matched = 0;
+  if (!walk(node, matched, path.substr(0, slash)) || matched != node->label_length) {
+    return PathNode();
+  }
+  if (slash == string_view::npos) return value(*node);
+
+  auto city = path.substr(slash + 1);
+  if (node->kind != PathNode::Country || city.find('/') != string_view::npos) {
+    return PathNode();
+  }
+  node = &_nodes[_countries[node->country]];
+  matched = node->label_length;
+  if (!walk(node, matched, "/") || !walk(node, matched, path_to_city(city)) ||
+      matched != node->label_length || node->kind != PathNode::City) {
+    return PathNode();
+  }
+  return value(*node);
+}
+
+// Visit node and then its children, skipping the one under node's path
+// if fn says to.  Others can be longer names, eg, /Nigeria below /Niger.
+// path holds everything above node.
+void PathIndex::visit(const Node& node, string& path, const Visitor& fn) const {
+  auto length = path.size();
+  path += label(node);
+  bool below = node.kind == PathNode::Missing || node.alias || fn(path, value(node));
+  for (uint32_t i = 0; i < node.child_count; ++i) {
+    auto& child = _nodes[node.first_child + i];
+    if (below || child.first_byte != '/') visit(child, path, fn);
+  }
+  path.resize(length);
+}
+
+void PathIndex::for_each(string_view prefix, const Visitor& fn) const {
+  string path;
+  size_t pos = 0;
+  for (auto node = _nodes.data(); node != nullptr;) {
+    auto text = label(*node);
+    auto rest = prefix.substr(pos);
+    if (rest.size() <= text.size()) {
+      if (text.substr(0, rest.size()) == rest) visit(*node, path, fn);
+      return;
+    }
+    if (rest.substr(0, text.size()) != text) return;
+    path += text;
+    pos += text.size();
+    node = child(*node, static_cast<uint8_t>(prefix[pos]));
+  }
+}
+
+}
@@ -0,0 +1,92 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_RADIX_HPP
+#define CITYFS_RADIX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cityfs.hpp"
+#include "cityfs_delta.hpp"
+
+namespace cityfs {
+
+  // A compressed radix tree over every virtual path of a store, /,
+  // /$country and /$country/$city, so a path resolves in one walk over
+  // its bytes.  Countries are keyed by display name and by code, cities
+  // by name, with find() dropping the extension as resolve_path does, so
+  // both agree and a miss is final.  Each node's children are contiguous
+  // and ordered by first byte, so the tree lists in order too.
+  //
+  // Names with a '/' can't be reached by path, so they're left out.
+  class PathIndex {
+    public:
+      explicit PathIndex(const CityStore& city_store);
+
+      // The index of city_store, patched with changes from the store
+      // previous indexes.  Its paths are carried over rather than sorted
+      // again, only those of changed cities keyed afresh.
+      PathIndex(const PathIndex& previous, const CityStore& city_store,
+          const StoreChanges& changes);
+
+      // What resolve_path(city_store, path) would.
+      PathNode find(std::string_view path) const;
+
+      // Call fn with each path starting with prefix, in byte order, by
+      // display name and without extensions.  fn returns false to skip
+      // the paths below the directory it was called with, eg, to list the
+      // countries of / without their cities.
+      typedef std::function<bool(std::string_view, const PathNode&)> Visitor;
+      void for_each(std::string_view prefix, const Visitor& fn) const;
+
+      size_t size() const { return _size; }
+      size_t node_count() const { return _nodes.size(); }
+
+    private:
+      struct Node {
+        uint32_t label_offset;
+        uint32_t label_length;
+        uint32_t first_child;
+        uint32_t city;
+        uint16_t child_count;
+        uint16_t country;
+        uint8_t kind;
+        uint8_t first_byte;
+        // A country by its code, listed by its name instead.
+        uint8_t alias;
+      };
+
+      struct Key {
+        std::string path;
+        PathNode node;
+        bool alias;
+      };
+      typedef std::vector<Key> Keys;
+
+      static constexpr uint32_t NoNode = ~uint32_t(0);
+
+      static std::string add_country(const CityStore& city_store, size_t country, Keys& keys);
+      static void add_city(const CityStore& city_store, size_t country, size_t city,
+          const std::string& directory, Keys& keys);
+      void build(Keys& keys);
+      void build(const Keys& keys, size_t begin, size_t end, size_t depth, uint32_t node);
+      const Node* child(const Node& node, uint8_t byte) const;
+      bool walk(const Node*& node, size_t& matched, std::string_view key) const;
+      void visit(const Node& node, std::string& path, const Visitor& fn) const;
+      std::string_view label(const Node& node) const {
+        return std::string_view(_labels.data() + node.label_offset, node.label_length);
+      }
+      static PathNode value(const Node& node);
+
+      std::string _labels;
+      std::vector<Node> _nodes;
+      // Each country's node by name, its cities are below it.
+      std::vector<uint32_t> _countries;
+      size_t _size = 0;
+  };
+}
+
+#endif
@@ -0,0 +1,264 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#include "cityfs_reload.hpp"
+#include "cityfs_decompress.hpp"
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace cityfs {
+
+using namespace std;
+
+// Self-pipe, the signal handler only writes a byte to wake the thread.
+static int reload_pipe[2] = {-1, -1};
+
+static const char ReloadByte = 'r';
+static const char StopByte = 's';
+
+// Editors often write a file in several steps, wait for them to settle.
+static const int WatchSettleMs = 200;
+
+// Only uncompressed city files can be diffed line by line.
+static bool diffable(const string& city_file) {
+  return !CityStore::is_snapshot(city_file) &&
+    compression_of(city_file) == Compression::None;
+}
+
+static void on_sighup(int) {
+  Reloader::request();
+}
+
+Reloader::Reloader(CityStoreRef& stores, string city_file, LoadOptions options):
+  _stores(&stores), _city_file(move(city_file)), _options(options),
+  _rows(_options.format) {}
+
+Reloader::Reloader(LazyCityStoreRef& stores, string city_file, LoadOptions options):
+  _lazy_stores(&stores), _city_file(move(city_file)), _options(options) {}
+
+Reloader::~Reloader() {
+  stop();
+}
+
+void Reloader::install_signal_handler() {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_sighup;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGHUP, &sa, NULL);
+}
+
+void Reloader::request() {
+  auto saved_errno = errno;
+  if (reload_pipe[1] >= 0) {
+    auto ignored = write(reload_pipe[1], &ReloadByte, 1);
+    (void)ignored;
+  }
+  errno = saved_errno;
+}
+
+void Reloader::load_in_background() {
+  lock_guard<mutex> lock(_state_mutex);
+  _state = LoadState::Loading;
+}
+
+// A watched file is parsed and indexed from one mapping, so an edit
+// landing in between can't be indexed as if it had been loaded.
+bool Reloader::load(CityStore& city_store, LoadStats* stats) {
+  _rows_valid = false;
+  if (!_watch || !diffable(_city_file)) {
+    return load_cities(_city_file, city_store, _options, stats);
+  }
+
+  MappedFile file;
+  if (!file.open(_city_file)) {
+    cerr << "Error reading " << _city_file << endl;
+    return false;
+  }
+  if (!parse_cities(_city_file, file, city_store, _options, stats)) return false;
+  _rows.build(file, city_store);
+  _rows_valid = true;
+  return true;
+}
+
+Reloader::LoadState Reloader::state() const {
+  lock_guard<mutex> lock(_state_mutex);
+  return _state;
+}
+
+Reloader::LoadState Reloader::wait_loaded(chrono::milliseconds timeout) const {
+  unique_lock<mutex> lock(_state_mutex);
+  _state_changed.wait_for(lock, timeout, [this] { return _state != LoadState::Loading; });
+  return _state;
+}
+
+void Reloader::loaded(bool success) {
+  {
+    lock_guard<mutex> lock(_state_mutex);
+    if (success) {
+      _state = LoadState::Loaded;
+    } else if (_state == LoadState::Loading) {
+      _state = LoadState::Failed;
+    }
+  }
+  _state_changed.notify_all();
+}
+
+void Reloader::watch(ChangeHook on_change) {
+  _watch = true;
+  _on_change = move(on_change);
+}
+
+void Reloader::before_publish(PublishHook on_publish) {
+  _on_publish = move(on_publish);
+}
+
+bool Reloader::start() {
+  if (_thread.joinable()) return true;
+  if (pipe(reload_pipe) != 0) {
+    cerr << "Error creating reload pipe" << endl;
+    return false;
+  }
+  if (_watch && !start_watch()) {
+    cerr << "Error watching " << _city_file << ", reloading on SIGHUP only" << endl;
+  }
+  fcntl(reload_pipe[1], F_SETFL, O_NONBLOCK);
+  _thread = thread(&Reloader::run, this);
+  return true;
+}
+
+void Reloader::stop() {
+  if (!_thread.joinable()) return;
+  auto ignored = write(reload_pipe[1], &StopByte, 1);
+  (void)ignored;
+  _thread.join();
+
+  close(reload_pipe[0]);
+  close(reload_pipe[1]);
+  reload_pipe[0] = reload_pipe[1] = -1;
+  if (_inotify >= 0) {
+    close(_inotify);
+    _inotify = -1;
+  }
+}
+
+bool Reloader::start_watch() {
+  // Watch the directory, editors and rsync replace the file by renaming
+  // over it, which would drop a watch on the file itself.
+  auto slash = _city_file.rfind('/');
+  auto dir = slash == string::npos ? string(".") :
+    slash == 0 ? string("/") : _city_file.substr(0, slash);
+
+  _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (_inotify < 0) return false;
+  if (inotify_add_watch(_inotify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    close(_inotify);
+    _inotify = -1;
+    return false;
+  }
+  return true;
+}
+
+bool Reloader::file_event(const char* events, size_t size) const {
+  auto slash = _city_file.rfind('/');
+  auto name = slash == string::npos ? _city_file : _city_file.substr(slash + 1);
+
+  for (size_t offset = 0; offset + sizeof(inotify_event) <= size;) {
+    auto event = reinterpret_cast<const inotify_event*>(events + offset);
+    if (event->len > 0 && name == event->name) return true;
+    offset += sizeof(inotify_event) + event->len;
+  }
+  return false;
+}
+
+void Reloader::run() {
+  if (state() == LoadState::Loading) {
+    reload();
+  }
+
+  pollfd fds[2] = {{reload_pipe[0], POLLIN, 0}, {_inotify, POLLIN, 0}};
+  nfds_t nfds = _inotify >= 0 ? 2 : 1;
+  bool changed = false;
+  while (true) {
+    auto ready = poll(fds, nfds, changed ? WatchSettleMs : -1);
+    if (ready < 0 && errno == EINTR) continue;
+    if (ready < 0) break;
+
+    if (ready == 0) {
+      changed = false;
+      if (!apply_changes()) reload();
+      continue;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      char command;
+      auto n = read(reload_pipe[0], &command, 1);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0 || command == StopByte) break;
+      changed = false;
+      reload();
+    }
+
+    if (nfds > 1 && (fds[1].revents & POLLIN)) {
+      alignas(inotify_event) char events[4096];
+      auto n = read(_inotify, events, sizeof(events));
+      if (n > 0 && file_event(events, n)) changed = true;
+    }
+  }
+}
+
+bool Reloader::apply_changes() {
+  if (!_rows_valid) return false;
+
+  auto base = _stores->current();
+  auto patched = make_shared<CityStore>();
+  StoreChanges changes;
+  if (!base || !_rows.apply(_city_file, *base, *patched, changes)) {
+    _rows_valid = false;
+    return false;
+  }
+  if (changes.empty()) return true;
+
+  if (_on_publish) _on_publish(base, patched, &changes);
+  _stores->publish(patched);
+  cerr << "Applied " << changes.size() << " changed cities from " << _city_file << endl;
+  if (_on_change) _on_change(*patched, changes);
+  return true;
+}
+
+bool Reloader::reload() {
+  LoadStats stats;
+  if (_lazy_stores) {
+    auto store = make_shared<LazyCityStore>();
+    if (!store->open(_city_file, _options, &stats)) {
+      cerr << "Reload of " << _city_file << " failed, keeping the current cities" << endl;
+      loaded(false);
+      return false;
+    }
+    auto countries = store->country_count();
+    if (_on_publish) _on_publish(nullptr, nullptr, nullptr);
+    _lazy_stores->publish(move(store));
+    loaded(true);
+    cerr << "Reopened " << _city_file << ": " << countries << " countries" << endl;
+    return true;
+  }
+
+  auto store = make_shared<CityStore>();
+  if (!load(*store, &stats)) {
+    cerr << "Reload of " << _city_file << " failed, keeping the current cities" << endl;
+    loaded(false);
+    return false;
+  }
+  if (_on_publish) _on_publish(_stores->current(), store, nullptr);
+  _stores->publish(move(store));
+  loaded(true);
+  cerr << "Reloaded " << _city_file << ": " << stats << endl;
+  return true;
+}
+
+}
@@ -0,0 +1,140 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_RELOAD_HPP
+#define CITYFS_RELOAD_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "cityfs.hpp"
+#include "cityfs_delta.hpp"
+#include "cityfs_lazy.hpp"
+#include "cityfs_store.hpp"
+
+namespace cityfs {
+
+  // A published store.  Readers hold a reference for the length of an
+  // operation while a reload swaps in a new store, the old store is
+  // freed once its last reader lets go.
+  template <typename Store>
+    class StoreRef {
+      public:
+        typedef std::shared_ptr<const Store> Ptr;
+
+        Ptr current() const {
+          return std::atomic_load(&_store);
+        }
+
+        void publish(Ptr store) {
+          std::atomic_store(&_store, std::move(store));
+          _generation.fetch_add(1);
+        }
+
+        // Bumped on every publish, so caches can tell they're stale.
+        uint64_t generation() const { return _generation.load(); }
+
+      private:
+        Ptr _store;
+        std::atomic<uint64_t> _generation{0};
+    };
+
+  typedef StoreRef<CityStore> CityStoreRef;
+  typedef CityStoreRef::Ptr CityStorePtr;
+  typedef StoreRef<LazyCityStore> LazyCityStoreRef;
+  typedef LazyCityStoreRef::Ptr LazyCityStorePtr;
+
+  typedef std::function<void(const CityStore&, const StoreChanges&)> ChangeHook;
+
+  // Called with a store about to be published and the one it replaces,
+  // and the changes if it was patched from that one, else null.  Loading
+  // lazily, both stores are null.
+  typedef std::function<void(const CityStorePtr& previous, const CityStorePtr& store,
+      const StoreChanges* changes)> PublishHook;
+
+  // Rebuilds the store from the city file on a background thread
+  // whenever SIGHUP arrives, publishing it when complete.  When watching,
+  // writes to a CSV city file are applied incrementally as they land.
+  // Mounting before the cities are loaded, it makes the first load too.
+  class Reloader {
+    public:
+      enum class LoadState {
+        Loading,
+        Loaded,
+        Failed
+      };
+
+      Reloader(CityStoreRef& stores, std::string city_file, LoadOptions options);
+
+      // Reload by re-opening the city file lazily.
+      Reloader(LazyCityStoreRef& stores, std::string city_file, LoadOptions options);
+      ~Reloader();
+
+      // Install the SIGHUP handler, before FUSE installs its own.
+      static void install_signal_handler();
+
+      // Watch the city file with inotify, calling on_change with the
+      // cities each incremental reload touched.  Call before start().
+      void watch(ChangeHook on_change);
+
+      // Call on_publish on the reload thread before each store is
+      // published, so what's derived from it is ready before readers see
+      // it, and what's cached of the old one can be dropped.  Call before
+      // start().
+      void before_publish(PublishHook on_publish);
+
+      // Make the first load on the reload thread once it starts, rather
+      // than expecting a store published already.  Call before start().
+      void load_in_background();
+
+      // Make the first load into city_store now, on this thread, for the
+      // caller to publish.  Call after watch(), so the lines it's patched
+      // by are indexed from the bytes loaded.
+      bool load(CityStore& city_store, LoadStats* stats);
+
+      // Start the reload thread, after FUSE has daemonized.
+      bool start();
+      void stop();
+
+      // Loaded once any load has published a store, Failed if the first
+      // one didn't and none has since.
+      LoadState state() const;
+
+      // Wait up to timeout for the first load to finish.
+      LoadState wait_loaded(std::chrono::milliseconds timeout) const;
+
+      // Queue a reload, safe to call from a signal handler.
+      static void request();
+
+    private:
+      void run();
+      bool reload();
+      bool apply_changes();
+      bool start_watch();
+      bool file_event(const char* events, size_t size) const;
+      void loaded(bool success);
+
+      CityStoreRef* _stores = nullptr;
+      LazyCityStoreRef* _lazy_stores = nullptr;
+      std::string _city_file;
+      LoadOptions _options;
+      std::thread _thread;
+
+      mutable std::mutex _state_mutex;
+      mutable std::condition_variable _state_changed;
+      LoadState _state = LoadState::Loaded;
+
+      bool _watch = false;
+      int _inotify = -1;
+      ChangeHook _on_change;
+      PublishHook _on_publish;
+      RowIndex _rows;
+      bool _rows_valid = false;
+  };
+}
+
+#endif
@@ -0,0 +1,120 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#include "cityfs_simd.hpp"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CITYFS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace cityfs {
+namespace simd {
+
+Masks scan_scalar(const char* block, size_t size, char delimiter) {
+  Masks masks = {0, 0, 0};
+  for (size_t i = 0; i < size; ++i) {
+    auto bit = uint64_t(1) << i;
+    auto c = block[i];
+    if (c == delimiter) {
+      masks.delimiters |= bit;
+    } else if (c == '\n') {
+      masks.newlines |= bit;
+    } else if (c == '"') {
+      masks.quotes |= bit;
+    }
+  }
+  return masks;
+}
+
+#ifdef CITYFS_X86
+
+__attribute__((target("sse2")))
+Masks scan_sse2(const char* block, size_t size, char delimiter) {
+  if (size < BlockSize) return scan_scalar(block, size, delimiter);
+
+  auto delimiters = _mm_set1_epi8(delimiter);
+  auto newlines = _mm_set1_epi8('\n');
+  auto quotes = _mm_set1_epi8('"');
+  Masks masks = {0, 0, 0};
+  for (unsigned i = 0; i < 4; ++i) {
+    auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+    auto shift = 16 * i;
+    masks.delimiters |= uint64_t(uint16_t(
+          _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, delimiters)))) << shift;
+    masks.newlines |= uint64_t(uint16_t(
+          _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newlines)))) << shift;
+    masks.quotes |= uint64_t(uint16_t(
+          _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quotes)))) << shift;
+  }
+  return masks;
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t match_mask(__m256i low, __m256i high, __m256i match) {
+  auto lo = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, match)));
+  auto hi = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, match)));
+  return uint64_t(lo) | (uint64_t(hi) << 32);
+}
+
+__attribute__((target("avx2")))
+Masks scan_avx2(const char* block, size_t size, char delimiter) {
+  if (size < BlockSize) return scan_scalar(block, size, delimiter);
+
+  auto delimiters = _mm256_set1_epi8(delimiter);
+  auto newlines = _mm256_set1_epi8('\n');
+  auto quotes = _mm256_set1_epi8('"');
+  auto low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+  auto high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+  Masks masks;
+  masks.delimiters = match_mask(low, high, delimiters);
+  masks.newlines = match_mask(low, high, newlines);
+  masks.quotes = match_mask(low, high, quotes);
+  return masks;
+}
+
+#else
+
+Masks scan_sse2(const char* block, size_t size, char delimiter) {
+  return scan_scalar(block, size, delimiter);
+}
+
+Masks scan_avx2(const char* block, size_t size, char delimiter) {
+  return scan_scalar(block, size, delimiter);
+}
+
+#endif
+
+BlockScanner scanner_named(const char* name) {
+  if (strcmp(name, "scalar") == 0) return scan_scalar;
+#ifdef CITYFS_X86
+  __builtin_cpu_init();
+  if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) return scan_sse2;
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) return scan_avx2;
+#endif
+  return nullptr;
+}
+
+static const char* pick_scanner() {
+  static const char* names[] = {"avx2", "sse2", "scalar"};
+  auto forced = getenv("CITYFS_SIMD");
+  for (auto name : names) {
+    if (forced != nullptr && strcmp(forced, name) != 0) continue;
+    if (scanner_named(name) != nullptr) return name;
+  }
+  return "scalar";
+}
+
+const char* block_scanner_name() {
+  static const char* name = pick_scanner();
+  return name;
+}
+
+BlockScanner block_scanner() {
+  static const BlockScanner scanner = scanner_named(block_scanner_name());
+  return scanner;
+}
+
+}
+}
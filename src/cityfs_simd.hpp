@@ -0,0 +1,40 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_SIMD_HPP
+#define CITYFS_SIMD_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cityfs {
+
+  // Vectorised search for the structural bytes of a city file.
+  namespace simd {
+
+    const size_t BlockSize = 64;
+
+    // Bit i of each mask is set if byte i of the block is that character.
+    struct Masks {
+      uint64_t delimiters;
+      uint64_t newlines;
+      uint64_t quotes;
+    };
+
+    // Scan one block of up to BlockSize bytes.
+    typedef Masks (*BlockScanner)(const char* block, size_t size, char delimiter);
+
+    Masks scan_scalar(const char* block, size_t size, char delimiter);
+    Masks scan_sse2(const char* block, size_t size, char delimiter);
+    Masks scan_avx2(const char* block, size_t size, char delimiter);
+
+    // The widest scanner the CPU supports, checked once.  CITYFS_SIMD=
+    // scalar, sse2 or avx2 in the environment narrows the choice.
+    BlockScanner block_scanner();
+    const char* block_scanner_name();
+
+    // The named scanner, or null if this CPU or build doesn't have it.
+    BlockScanner scanner_named(const char* name);
+  }
+}
+
+#endif
@@ -0,0 +1,481 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#include "cityfs_store.hpp"
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+namespace cityfs {
+
+using namespace std;
+
+static size_t align8(size_t n) {
+  return (n + 7) & ~static_cast<size_t>(7);
+}
+
+namespace {
+
+  class StringPool {
+    public:
+      db::String add(string_view s) {
+        db::String ref{static_cast<uint32_t>(_pool.size()),
+          static_cast<uint32_t>(s.size())};
+        _pool += s;
+        return ref;
+      }
+      const string& str() const { return _pool; }
+
+    private:
+      string _pool;
+  };
+
+  template <typename T>
+    void copy_section(vector<char>& image, const db::Header& header,
+        db::Section section, const vector<T>& values) {
+      if (!values.empty()) {
+        memcpy(image.data() + header.sections[section], values.data(),
+            values.size() * sizeof(T));
+      }
+    }
+}
+
+bool CityStoreBuilder::intern(
+    FlatIndex& ids,
+    vector<string>& values,
+    string_view value,
+    uint16_t& id) {
+
+  auto h = filter::hash(value);
+  auto found = ids.find(h, [&values, value](uint32_t id) { return values[id] == value; });
+  if (found != FlatIndex::npos) {
+    id = static_cast<uint16_t>(found);
+    return true;
+  }
+  if (values.size() == MaxIds) {
+    _overflowed = true;
+    return false;
+  }
+  values.emplace_back(value);
+  ids.insert(h, static_cast<uint32_t>(values.size() - 1));
+  id = static_cast<uint16_t>(values.size() - 1);
+  return true;
+}
+
+bool CityStoreBuilder::add(const CityRow& row) {
+  int32_t latitude = 0, longitude = 0;
+  uint32_t population = 0;
+  uint16_t country = 0, timezone = 0;
+  auto bad = CityFormat::FieldCount;
+  string_view text;
+  if (!parse_coordinate(row.latitude, latitude)) {
+    bad = CityFormat::Latitude;
+    text = row.latitude;
+  } else if (!parse_coordinate(row.longitude, longitude)) {
+    bad = CityFormat::Longitude;
+    text = row.longitude;
+  } else if (!parse_population(row.population, population)) {
+    bad = CityFormat::Population;
+    text = row.population;
+  } else if (!intern(_country_ids, _country_codes, row.country_code, country)) {
+    bad = CityFormat::CountryCode;
+    text = row.country_code;
+  } else if (!intern(_timezone_ids, _timezone_names, row.timezone, timezone)) {
+    bad = CityFormat::Timezone;
+    text = row.timezone;
+  }
+  if (bad != CityFormat::FieldCount) {
+    if (_errors.size() < MaxErrors) {
+      _errors.push_back({row.line, bad, string(text)});
+    }
+    ++_error_count;
+    return false;
+  }
+
+  auto name = row.name.substr(0, UINT16_MAX);
+  _name_offsets.push_back(static_cast<uint32_t>(_names.size()));
+  _name_lengths.push_back(static_cast<uint16_t>(name.size()));
+  _names += name;
+
+  _countries.push_back(country);
+  _timezones.push_back(timezone);
+  _latitudes.push_back(latitude);
+  _longitudes.push_back(longitude);
+  _populations.push_back(population);
+  return true;
+}
+
+bool CityStoreBuilder::add(string_view country_code, const CityView& city) {
+  uint16_t country = 0, timezone = 0;
+  if (!intern(_country_ids, _country_codes, country_code, country) ||
+      !intern(_timezone_ids, _timezone_names, city.timezone, timezone)) {
+    return false;
+  }
+
+  _name_offsets.push_back(static_cast<uint32_t>(_names.size()));
+  _name_lengths.push_back(static_cast<uint16_t>(city.name.size()));
+  _names += city.name;
+
+  _countries.push_back(country);
+  _timezones.push_back(timezone);
+  _latitudes.push_back(city.latitude);
+  _longitudes.push_back(city.longitude);
+  _populations.push_back(city.population);
+  return true;
+}
+
+bool CityStoreBuilder::append(const CityStoreBuilder& rhs, size_t line_offset) {
+  _overflowed = _overflowed || rhs._overflowed;
+  vector<uint16_t> country_ids(rhs._country_codes.size());
+  vector<uint16_t> timezone_ids(rhs._timezone_names.size());
+  for (size_t i = 0; i < country_ids.size(); ++i) {
+    if (!intern(_country_ids, _country_codes, rhs._country_codes[i], country_ids[i])) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < timezone_ids.size(); ++i) {
+    if (!intern(_timezone_ids, _timezone_names, rhs._timezone_names[i], timezone_ids[i])) {
+      return false;
+    }
+  }
+
+  auto name_base = static_cast<uint32_t>(_names.size());
+  _names += rhs._names;
+  for (auto offset : rhs._name_offsets) {
+    _name_offsets.push_back(name_base + offset);
+  }
+  for (auto id : rhs._countries) {
+    _countries.push_back(country_ids[id]);
+  }
+  for (auto id : rhs._timezones) {
+    _timezones.push_back(timezone_ids[id]);
+  }
+  _name_lengths.insert(_name_lengths.end(),
+      rhs._name_lengths.begin(), rhs._name_lengths.end());
+  _latitudes.insert(_latitudes.end(),
+      rhs._latitudes.begin(), rhs._latitudes.end());
+  _longitudes.insert(_longitudes.end(),
+      rhs._longitudes.begin(), rhs._longitudes.end());
+  _populations.insert(_populations.end(),
+      rhs._populations.begin(), rhs._populations.end());
+
+  for (auto& error : rhs._errors) {
+    if (_errors.size() == MaxErrors) break;
+    _errors.push_back({error.line + line_offset, error.field, error.text});
+  }
+  _error_count += rhs._error_count;
+  return true;
+}
+
+void report_errors(const string& path, const CityStoreBuilder& builder) {
+  for (auto& error : builder.errors()) {
+    cerr << "Error " << path << ":" << error.line << ": bad "
+      << CityFormat::field_name(error.field) << " '" << error.text << "'" << endl;
+  }
+  if (builder.error_count() > builder.errors().size()) {
+    cerr << "Error " << path << ": "
+      << builder.error_count() - builder.errors().size() << " more bad rows" << endl;
+  }
+  if (builder.overflowed()) {
+    cerr << "Error " << path << ": more than " << CityStoreBuilder::MaxIds
+      << " country codes or timezones" << endl;
+  }
+}
+
+void CityStore::build(const CityStoreBuilder& builder, bool presorted) {
+
+  auto name = [&builder](size_t row) {
+    return string_view(builder._names.data() + builder._name_offsets[row],
+        builder._name_lengths[row]);
+  };
+
+  // Rank country ids by code so rows sort by (code, name).
+  vector<uint16_t> by_code(builder._country_codes.size());
+  iota(by_code.begin(), by_code.end(), 0);
+  sort(by_code.begin(), by_code.end(), [&builder](uint16_t a, uint16_t b) {
+      return builder._country_codes[a] < builder._country_codes[b];
+    });
+  vector<uint16_t> rank(by_code.size());
+  for (size_t i = 0; i < by_code.size(); ++i) {
+    rank[by_code[i]] = static_cast<uint16_t>(i);
+  }
+
+  // A stable sort keeps file order within duplicates, so the first wins.
+  vector<uint32_t> order(builder.size());
+  iota(order.begin(), order.end(), 0);
+  if (!presorted) {
+    stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        auto country_a = rank[builder._countries[a]];
+        auto country_b = rank[builder._countries[b]];
+        if (country_a != country_b) return country_a < country_b;
+        return name(a) < name(b);
+      });
+    order.erase(unique(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return builder._countries[a] == builder._countries[b] && name(a) == name(b);
+      }), order.end());
+  }
+
+  StringPool strings;
+  vector<db::String> timezones;
+  for (auto& timezone : builder._timezone_names) {
+    timezones.push_back(strings.add(timezone));
+  }
+
+  vector<db::Country> countries;
+  vector<uint32_t> name_offsets;
+  vector<uint16_t> name_lengths, timezone_ids;
+  vector<int32_t> latitudes, longitudes;
+  vector<uint32_t> populations;
+  name_offsets.reserve(order.size());
+  name_lengths.reserve(order.size());
+  timezone_ids.reserve(order.size());
+  latitudes.reserve(order.size());
+  longitudes.reserve(order.size());
+  populations.reserve(order.size());
+
+  for (size_t i = 0; i < order.size(); ++i) {
+    auto row = order[i];
+    auto country = builder._countries[row];
+    if (countries.empty() ||
+        builder._countries[order[countries.back().city_begin]] != country) {
+      if (!countries.empty()) {
+        countries.back().city_end = static_cast<uint32_t>(i);
+      }
+      countries.push_back({strings.add(builder._country_codes[country]),
+          static_cast<uint32_t>(i), 0});
+    }
+
+    auto ref = strings.add(name(row));
+    name_offsets.push_back(ref.offset);
+    name_lengths.push_back(builder._name_lengths[row]);
+    timezone_ids.push_back(builder._timezones[row]);
+    latitudes.push_back(builder._latitudes[row]);
+    longitudes.push_back(builder._longitudes[row]);
+    populations.push_back(builder._populations[row]);
+  }
+  if (!countries.empty()) {
+    countries.back().city_end = static_cast<uint32_t>(order.size());
+  }
+
+  // Cities are keyed by name seeded with their country's code hash, so a
+  // name that only exists in another country still misses.  The flat
+  // indexes take the same hashes.
+  vector<uint64_t> filter(filter::words_for(countries.size() + order.size()), 0);
+  FlatIndex country_index, city_index;
+  for (uint32_t i = 0; i < countries.size(); ++i) {
+    auto& country = countries[i];
+    auto code_hash = filter::hash(strings.str().substr(country.code.offset, country.code.length));
+    filter::add(filter, code_hash);
+    country_index.insert(code_hash, i);
+    for (auto city = country.city_begin; city < country.city_end; ++city) {
+      auto h = filter::hash(name(order[city]), code_hash);
+      filter::add(filter, h);
+      city_index.insert(h, city);
+    }
+  }
+
+  db::Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, db::Magic, sizeof(header.magic));
+  header.version = db::Version;
+  header.country_count = static_cast<uint32_t>(countries.size());
+  header.city_count = static_cast<uint32_t>(order.size());
+  header.timezone_count = static_cast<uint32_t>(timezones.size());
+  header.strings_size = strings.str().size();
+  header.filter_words = filter.size();
+  header.country_slots = country_index.slots();
+  header.city_slots = city_index.slots();
+
+  size_t sizes[db::SectionCount];
+  sizes[db::Timezones] = timezones.size() * sizeof(db::String);
+  sizes[db::Countries] = countries.size() * sizeof(db::Country);
+  sizes[db::NameOffsets] = order.size() * sizeof(uint32_t);
+  sizes[db::NameLengths] = order.size() * sizeof(uint16_t);
+  sizes[db::TimezoneIds] = order.size() * sizeof(uint16_t);
+  sizes[db::Latitudes] = order.size() * sizeof(int32_t);
+  sizes[db::Longitudes] = order.size() * sizeof(int32_t);
+  sizes[db::Populations] = order.size() * sizeof(uint32_t);
+  sizes[db::Strings] = header.strings_size;
+  sizes[db::NameFilter] = filter.size() * sizeof(uint64_t);
+  sizes[db::CountryControl] = header.country_slots * sizeof(int8_t);
+  sizes[db::CountryIndexes] = header.country_slots * sizeof(uint32_t);
+  sizes[db::CityControl] = header.city_slots * sizeof(int8_t);
+  sizes[db::CityIndexes] = header.city_slots * sizeof(uint32_t);
+
+  size_t offset = align8(sizeof(header));
+  for (int section = 0; section < db::SectionCount; ++section) {
+    header.sections[section] = offset;
+    offset = align8(offset + sizes[section]);
+  }
+  header.image_size = offset;
+
+  vector<char> image(header.image_size, 0);
+  memcpy(image.data(), &header, sizeof(header));
+  copy_section(image, header, db::Timezones, timezones);
+  copy_section(image, header, db::Countries, countries);
+  copy_section(image, header, db::NameOffsets, name_offsets);
+  copy_section(image, header, db::NameLengths, name_lengths);
+  copy_section(image, header, db::TimezoneIds, timezone_ids);
+  copy_section(image, header, db::Latitudes, latitudes);
+  copy_section(image, header, db::Longitudes, longitudes);
+  copy_section(image, header, db::Populations, populations);
+  copy_section(image, header, db::NameFilter, filter);
+  auto copy_table = [&image, &header](db::Section control, db::Section indexes,
+      const FlatIndex& index) {
+    memcpy(image.data() + header.sections[control], index.control(), index.slots());
+    memcpy(image.data() + header.sections[indexes], index.indexes(),
+        index.slots() * sizeof(uint32_t));
+  };
+  copy_table(db::CountryControl, db::CountryIndexes, country_index);
+  copy_table(db::CityControl, db::CityIndexes, city_index);
+  memcpy(image.data() + header.sections[db::Strings], strings.str().data(),
+      strings.str().size());
+
+  _file.close();
+  _image = move(image);
+  attach(_image.data(), _image.size());
+}
+
+bool CityStore::is_snapshot(const string& path) {
+  ifstream ifs(path, ios::binary);
+  char magic[sizeof(db::Magic)];
+  return ifs.read(magic, sizeof(magic)) &&
+    memcmp(magic, db::Magic, sizeof(magic)) == 0;
+}
+
+bool CityStore::load(const string& path) {
+  MappedFile file;
+  if (!file.open(path)) {
+    cerr << "Error reading " << path << endl;
+    return false;
+  }
+  if (!attach(file.data(), file.size())) {
+    cerr << "Error, " << path << " is not a cityfs snapshot" << endl;
+    return false;
+  }
+  // Freed rather than cleared, a store built in memory before would
+  // otherwise keep its image's capacity as well as the mapping.
+  vector<char>().swap(_image);
+  _file = move(file);
+  return true;
+}
+
+bool CityStore::view(const char* image, size_t size) {
+  if (!attach(image, size)) return false;
+  vector<char>().swap(_image);
+  _file.close();
+  return true;
+}
+
+bool CityStore::save(const string& path) const {
+  if (!_header) return false;
+
+  ofstream ofs(path, ios::binary | ios::trunc);
+  ofs.write(reinterpret_cast<const char*>(_header), _header->image_size);
+  if (!ofs) {
+    cerr << "Error writing " << path << endl;
+    return false;
+  }
+  return true;
+}
+
+// Point the columns into an image.  Only the header and section bounds
+// are checked, column contents are trusted so attaching stays O(1).
+bool CityStore::attach(const char* image, size_t size) {
+  if (size < sizeof(db::Header)) return false;
+
+  auto header = reinterpret_cast<const db::Header*>(image);
+  if (memcmp(header->magic, db::Magic, sizeof(db::Magic)) != 0 ||
+      header->version != db::Version ||
+      header->image_size > size) {
+    return false;
+  }
+
+  size_t cities = header->city_count;
+  size_t sizes[db::SectionCount];
+  sizes[db::Timezones] = header->timezone_count * sizeof(db::String);
+  sizes[db::Countries] = header->country_count * sizeof(db::Country);
+  sizes[db::NameOffsets] = cities * sizeof(uint32_t);
+  sizes[db::NameLengths] = cities * sizeof(uint16_t);
+  sizes[db::TimezoneIds] = cities * sizeof(uint16_t);
+  sizes[db::Latitudes] = cities * sizeof(int32_t);
+  sizes[db::Longitudes] = cities * sizeof(int32_t);
+  sizes[db::Populations] = cities * sizeof(uint32_t);
+  sizes[db::Strings] = header->strings_size;
+  sizes[db::NameFilter] = header->filter_words * sizeof(uint64_t);
+  sizes[db::CountryControl] = header->country_slots * sizeof(int8_t);
+  sizes[db::CountryIndexes] = header->country_slots * sizeof(uint32_t);
+  sizes[db::CityControl] = header->city_slots * sizeof(int8_t);
+  sizes[db::CityIndexes] = header->city_slots * sizeof(uint32_t);
+  if ((header->filter_words & (header->filter_words - 1)) != 0 ||
+      !FlatIndex::valid_slots(header->country_slots) ||
+      !FlatIndex::valid_slots(header->city_slots)) {
+    return false;
+  }
+  for (int section = 0; section < db::SectionCount; ++section) {
+    if (header->sections[section] + sizes[section] > header->image_size) {
+      return false;
+    }
+  }
+
+  auto section = [image, header](db::Section s) {
+    return image + header->sections[s];
+  };
+  _header = header;
+  _timezones = reinterpret_cast<const db::String*>(section(db::Timezones));
+  _countries = reinterpret_cast<const db::Country*>(section(db::Countries));
+  _name_offsets = reinterpret_cast<const uint32_t*>(section(db::NameOffsets));
+  _name_lengths = reinterpret_cast<const uint16_t*>(section(db::NameLengths));
+  _timezone_ids = reinterpret_cast<const uint16_t*>(section(db::TimezoneIds));
+  _latitudes = reinterpret_cast<const int32_t*>(section(db::Latitudes));
+  _longitudes = reinterpret_cast<const int32_t*>(section(db::Longitudes));
+  _populations = reinterpret_cast<const uint32_t*>(section(db::Populations));
+  _strings = section(db::Strings);
+  _filter = reinterpret_cast<const uint64_t*>(section(db::NameFilter));
+  _country_control = reinterpret_cast<const int8_t*>(section(db::CountryControl));
+  _country_indexes = reinterpret_cast<const uint32_t*>(section(db::CountryIndexes));
+  _city_control = reinterpret_cast<const int8_t*>(section(db::CityControl));
+  _city_indexes = reinterpret_cast<const uint32_t*>(section(db::CityIndexes));
+  return true;
+}
+
+CityView CityStore::city(size_t city) const {
+  auto timezone_id = _timezone_ids[city];
+  auto timezone = timezone_id < timezone_count() ?
+    str(_timezones[timezone_id]) : string_view();
+  return {city_name(city), _latitudes[city], _longitudes[city],
+    _populations[city], timezone};
+}
+
+bool CityStore::may_have_country(string_view code) const {
+  return filter::may_contain(_filter, filter_words(), filter::hash(code));
+}
+
+bool CityStore::may_have_city(size_t country, string_view name) const {
+  auto code_hash = filter::hash(country_code(country));
+  return filter::may_contain(_filter, filter_words(), filter::hash(name, code_hash));
+}
+
+size_t CityStore::find_country(string_view code) const {
+  if (!_header) return npos;
+  auto h = filter::hash(code);
+  if (!filter::may_contain(_filter, filter_words(), h)) return npos;
+  auto country = FlatIndex::find(_country_control, _country_indexes,
+      _header->country_slots, h, [this, code](uint32_t country) {
+        return country_code(country) == code;
+      });
+  return country == FlatIndex::npos ? npos : country;
+}
+
+size_t CityStore::find_city(size_t country, string_view name) const {
+  auto h = filter::hash(name, filter::hash(country_code(country)));
+  if (!filter::may_contain(_filter, filter_words(), h)) return npos;
+  auto first = city_begin(country);
+  auto last = city_end(country);
+  auto city = FlatIndex::find(_city_control, _city_indexes,
+      _header->city_slots, h, [this, first, last, name](uint32_t city) {
+        return city >= first && city < last && city_name(city) == name;
+      });
+  return city == FlatIndex::npos ? npos : city;
+}
+
+}
@@ -0,0 +1,246 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_STORE_HPP
+#define CITYFS_STORE_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cityfs.hpp"
+#include "cityfs_csv.hpp"
+#include "cityfs_filter.hpp"
+#include "cityfs_flat.hpp"
+#include "mapped_file.hpp"
+
+namespace cityfs {
+
+  // On-disk layout of a compiled city database (.cfsdb).  Every reference
+  // is an offset from the start of the image, so the same bytes work
+  // in memory, mapped from a file or shared between processes.
+  namespace db {
+
+    const char Magic[8] = {'C', 'I', 'T', 'Y', 'F', 'S', 'D', 'B'};
+    const uint32_t Version = 6;
+
+    struct String {
+      uint32_t offset;
+      uint32_t length;
+    };
+
+    // Countries are sorted by code, each owning a [city_begin, city_end)
+    // run of cities sorted by name, so the run is the city name index.
+    struct Country {
+      String code;
+      uint32_t city_begin;
+      uint32_t city_end;
+    };
+
+    // The city columns, each an array of city_count values.
+    enum Section {
+      Timezones,     // db::String[timezone_count]
+      Countries,     // db::Country[country_count]
+      NameOffsets,   // uint32_t, into the string pool
+      NameLengths,   // uint16_t
+      TimezoneIds,   // uint16_t, into Timezones
+      Latitudes,     // int32_t, fixed-point
+      Longitudes,    // int32_t, fixed-point
+      Populations,   // uint32_t
+      Strings,       // char[strings_size]
+      NameFilter,    // uint64_t[filter_words], over country codes and names
+      CountryControl,  // int8_t[country_slots], FlatIndex of countries by code
+      CountryIndexes,  // uint32_t[country_slots]
+      CityControl,     // int8_t[city_slots], FlatIndex of cities by name,
+      CityIndexes,     // uint32_t[city_slots], hashed like the filter's keys
+      SectionCount
+    };
+
+    struct Header {
+      char magic[8];
+      uint32_t version;
+      uint32_t country_count;
+      uint32_t city_count;
+      uint32_t timezone_count;
+      uint64_t strings_size;
+      uint64_t image_size;
+      uint64_t filter_words;
+      uint64_t country_slots;
+      uint64_t city_slots;
+      uint64_t sections[SectionCount];
+    };
+  }
+
+  struct CityView {
+    std::string_view name;
+    int32_t latitude;
+    int32_t longitude;
+    uint32_t population;
+    std::string_view timezone;
+  };
+
+  // A row skipped because a number in it didn't parse.
+  struct ParseError {
+    size_t line;
+    CityFormat::Field field;
+    std::string text;
+  };
+
+  // Parsed cities in file order, one column per field.  Country codes
+  // and timezones are interned as they're added.
+  class CityStoreBuilder {
+    public:
+      // Only the first few errors are kept, the rest are just counted.
+      static const size_t MaxErrors = 10;
+
+      // Country codes and timezones get 16 bit ids.
+      static const size_t MaxIds = size_t(UINT16_MAX) + 1;
+
+      // Add a row, false if it was skipped for a bad number or for
+      // needing an id once they're all taken.
+      bool add(const CityRow& row);
+
+      // Add an already parsed city, eg, one copied from another store,
+      // false if it needs an id once they're all taken.
+      bool add(std::string_view country_code, const CityView& city);
+
+      // Append another builder's rows after ours, eg, a later chunk whose
+      // error lines are line_offset lines into the file.  False if its
+      // codes and timezones don't fit in ours.
+      bool append(const CityStoreBuilder& rhs, size_t line_offset = 0);
+
+      size_t size() const { return _countries.size(); }
+
+      const std::vector<ParseError>& errors() const { return _errors; }
+      size_t error_count() const { return _error_count; }
+
+      // True once a city was dropped for running out of ids, so the
+      // cities are incomplete and shouldn't be loaded.
+      bool overflowed() const { return _overflowed; }
+
+    private:
+      friend class CityStore;
+
+      bool intern(
+          FlatIndex& ids,
+          std::vector<std::string>& values,
+          std::string_view value,
+          uint16_t& id);
+
+      std::string _names;
+      std::vector<uint32_t> _name_offsets;
+      std::vector<uint16_t> _name_lengths;
+      std::vector<uint16_t> _countries;
+      std::vector<uint16_t> _timezones;
+      std::vector<int32_t> _latitudes;
+      std::vector<int32_t> _longitudes;
+      std::vector<uint32_t> _populations;
+
+      std::vector<std::string> _country_codes;
+      std::vector<std::string> _timezone_names;
+      FlatIndex _country_ids;
+      FlatIndex _timezone_ids;
+
+      std::vector<ParseError> _errors;
+      size_t _error_count = 0;
+      bool _overflowed = false;
+  };
+
+  // Print the builder's skipped rows as path:line errors, or how many
+  // there were past the first few, and whether it ran out of ids.
+  void report_errors(const std::string& path, const CityStoreBuilder& builder);
+
+  // Read-only, columnar city store over a db image, either built in
+  // memory from parsed cities or mapped straight from a snapshot file.
+  // Cities are grouped by country, so listing a country is a linear
+  // sweep over its [city_begin, city_end) range of each column.
+  class CityStore {
+    public:
+      static const size_t npos = static_cast<size_t>(-1);
+
+      CityStore() = default;
+      CityStore(const CityStore&) = delete;
+      CityStore& operator=(const CityStore&) = delete;
+      CityStore(CityStore&&) = default;
+      CityStore& operator=(CityStore&&) = default;
+
+      // Build an in-memory image, keeping the first row of any
+      // duplicate country + city.  Presorted builders, already ordered 
+      // by (country code, name) without duplicates, skip the sort.
+      void build(const CityStoreBuilder& builder, bool presorted = false);
+
+      // Map a snapshot written by save().
+      bool load(const std::string& path);
+
+      // Use an image that outlives the store in place, eg, one compiled
+      // into the binary.
+      bool view(const char* image, size_t size);
+      bool save(const std::string& path) const;
+
+      // True if path starts with the snapshot magic.
+      static bool is_snapshot(const std::string& path);
+
+      size_t country_count() const { return _header ? _header->country_count : 0; }
+      size_t city_count() const { return _header ? _header->city_count : 0; }
+      size_t timezone_count() const { return _header ? _header->timezone_count : 0; }
+      size_t image_size() const { return _header ? _header->image_size : 0; }
+      const char* image() const { return reinterpret_cast<const char*>(_header); }
+
+      std::string_view country_code(size_t country) const {
+        return str(_countries[country].code);
+      }
+
+      size_t city_begin(size_t country) const {
+        return _countries[country].city_begin;
+      }
+      size_t city_end(size_t country) const {
+        return _countries[country].city_end;
+      }
+
+      std::string_view city_name(size_t city) const {
+        return std::string_view(_strings + _name_offsets[city], _name_lengths[city]);
+      }
+
+      CityView city(size_t city) const;
+
+      // False if the name filter rules the country or city out, true if
+      // it may be there.
+      bool may_have_country(std::string_view code) const;
+      bool may_have_city(size_t country, std::string_view name) const;
+
+      // Probes of the image's flat indexes, returning npos if missing.
+      // Most misses are turned away by the name filter first.
+      size_t find_country(std::string_view code) const;
+      size_t find_city(size_t country, std::string_view name) const;
+
+      const int32_t* latitudes() const { return _latitudes; }
+      const int32_t* longitudes() const { return _longitudes; }
+      const uint32_t* populations() const { return _populations; }
+
+    private:
+      bool attach(const char* image, size_t size);
+      size_t filter_words() const { return _header ? _header->filter_words : 0; }
+      std::string_view str(db::String s) const {
+        return std::string_view(_strings + s.offset, s.length);
+      }
+
+      std::vector<char> _image;
+      MappedFile _file;
+      const db::Header* _header = nullptr;
+      const db::String* _timezones = nullptr;
+      const db::Country* _countries = nullptr;
+      const uint32_t* _name_offsets = nullptr;
+      const uint16_t* _name_lengths = nullptr;
+      const uint16_t* _timezone_ids = nullptr;
+      const int32_t* _latitudes = nullptr;
+      const int32_t* _longitudes = nullptr;
+      const uint32_t* _populations = nullptr;
+      const char* _strings = nullptr;
+      const uint64_t* _filter = nullptr;
+      const int8_t* _country_control = nullptr;
+      const uint32_t* _country_indexes = nullptr;
+      const int8_t* _city_control = nullptr;
+      const uint32_t* _city_indexes = nullptr;
+  };
+}
+
+#endif
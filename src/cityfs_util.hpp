@@ -1,46 +1,87 @@
 #ifndef CITYFS_UTIL_HPP
 #define CITYFS_UTIL_HPP
 
-#include <sstream>
-#include <string>
-#include <vector>
-#include <unordered_map>
+#include <cstddef>
+#include <iterator>
+#include <string_view>
 
 namespace cityfs { namespace util {
 
-  template <typename T>
-    void index_map(std::unordered_map<std::string, T>& items, 
-        std::vector<std::string>& index) {
+  // The delimited tokens of a string as views into it, without
+  // allocating, eg,
+  //
+  //   for (auto component : Tokens("Australia/Brisbane.txt", '/')) ...
+  //
+  // An empty string has no tokens, otherwise there's one more token than
+  // delimiters, empty or not.
+  class Tokens {
+    public:
+      class iterator {
+        public:
+          typedef std::forward_iterator_tag iterator_category;
+          typedef std::string_view value_type;
+          typedef std::ptrdiff_t difference_type;
+          typedef const std::string_view* pointer;
+          typedef const std::string_view& reference;
 
-      index.clear();
-      index.reserve(items.size());
-      for (auto item : items) {
-        index.push_back(item.first);
+          iterator() = default;
+          iterator(std::string_view text, char delimiter):
+            _rest(text), _delimiter(delimiter), _done(false) {
+            next();
+          }
+
+          reference operator*() const { return _token; }
+          pointer operator->() const { return &_token; }
+
+          iterator& operator++() {
+            next();
+            return *this;
+          }
+          iterator operator++(int) {
+            auto previous = *this;
+            next();
+            return previous;
+          }
+
+          bool operator==(const iterator& rhs) const {
+            return _done == rhs._done && (_done || _token.data() == rhs._token.data());
+          }
+          bool operator!=(const iterator& rhs) const { return !(*this == rhs); }
+
+        private:
+          void next() {
+            if (_last) {
+              _done = true;
+              return;
+            }
+            auto pos = _rest.find(_delimiter);
+            _token = _rest.substr(0, pos);
+            if (pos == std::string_view::npos) {
+              _last = true;
+            } else {
+              _rest.remove_prefix(pos + 1);
+            }
+          }
+
+          std::string_view _rest;
+          std::string_view _token;
+          char _delimiter = 0;
+          bool _last = false;
+          bool _done = true;
+      };
+
+      Tokens(std::string_view text, char delimiter):
+        _text(text), _delimiter(delimiter) {}
+
+      iterator begin() const {
+        return _text.empty() ? iterator() : iterator(_text, _delimiter);
       }
-    }
-
-  inline std::vector<std::string> split(
-      const std::string& s, 
-      char delimiter) {
-
-    std::stringstream iss(s);
-    std::string line;
-    std::vector<std::string> tokens;
-    tokens.reserve(8);
-    while (getline(iss, line, delimiter)) {
-      tokens.push_back(line);
-    }
-    return tokens;
-  }
-
-  inline std::string trim_extension(const std::string& path) {
-
-    auto idx = path.find_last_of("."); 
-    if (idx == std::string::npos) {
-      return path;
-    }
-    return path.substr(0, idx); 
-  }
+      iterator end() const { return iterator(); }
+
+    private:
+      std::string_view _text;
+      char _delimiter;
+  };
 
 }
 }
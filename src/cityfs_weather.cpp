@@ -46,5 +46,31 @@ namespace cityfs {
     return oss.str();
   }
 
+  // Fetched without the lock, so a slow fetch doesn't hold up other
+  // cities.  Two opens of an expired city may both fetch it.
+  string WeatherCache::weather(const string& city, bool* fetched) {
+    auto now = chrono::steady_clock::now();
+    {
+      lock_guard<mutex> lock(_mutex);
+      auto iter = _entries.find(city);
+      if (iter != _entries.end() && now - iter->second.fetched < _ttl) {
+        if (fetched) *fetched = false;
+        return iter->second.weather;
+      }
+    }
+
+    auto weather = weather_content(city);
+    bool refreshed = false;
+    {
+      lock_guard<mutex> lock(_mutex);
+      auto& entry = _entries[city];
+      refreshed = !entry.weather.empty() && entry.weather != weather;
+      entry.weather = weather;
+      entry.fetched = now;
+    }
+    if (refreshed && _on_refresh) _on_refresh(city);
+    if (fetched) *fetched = true;
+    return weather;
+  }
 
 }
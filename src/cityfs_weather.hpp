@@ -3,12 +3,44 @@
 #ifndef CITYFS_WEATHER_HPP
 #define CITYFS_WEATHER_HPP
 
+#include <chrono>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 namespace cityfs {
 
   void weather_init();
   std::string weather_content(const std::string& city);
+
+  // Weather by city name, fetched at most once a ttl.  A fetch replacing
+  // different weather calls the refresh hook, eg, to have the kernel drop
+  // pages rendered with the old.
+  class WeatherCache {
+    public:
+      typedef std::function<void(const std::string& city)> RefreshHook;
+
+      explicit WeatherCache(std::chrono::seconds ttl): _ttl(ttl) {}
+
+      // Call before weather() is.
+      void on_refresh(RefreshHook hook) { _on_refresh = std::move(hook); }
+
+      // The city's weather, fetched unless it's younger than ttl.
+      // fetched is set if this call fetched it.
+      std::string weather(const std::string& city, bool* fetched = nullptr);
+
+    private:
+      struct Entry {
+        std::string weather;
+        std::chrono::steady_clock::time_point fetched;
+      };
+
+      std::chrono::seconds _ttl;
+      RefreshHook _on_refresh;
+      std::mutex _mutex;
+      std::unordered_map<std::string, Entry> _entries;
+  };
 }
 
 #endif
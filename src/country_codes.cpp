@@ -1,277 +1,364 @@
 #include "country_codes.hpp"
+#include <array>
+#include <cstdint>
 
-typedef std::unordered_map<std::string, std::string> StringMap;
+namespace {
 
-CountryCodeMap all_country_codes() {
-  StringMap codes;
-  codes.insert({ "AF", "Afghanistan"});
-  codes.insert({ "AL", "Albania" });
-  codes.insert({ "DZ", "Algeria" });
-  codes.insert({ "AS", "American Samoa" });
-  codes.insert({ "AD", "Andorra" });
-  codes.insert({ "AO", "Angola" });
-  codes.insert({ "AI", "Anguilla" });
-  codes.insert({ "AQ", "Antarctica" });
-  codes.insert({ "AG", "Antigua and Barbuda" });
-  codes.insert({ "AR", "Argentina" });
-  codes.insert({ "AM", "Armenia" });
-  codes.insert({ "AW", "Aruba" });
-  codes.insert({ "AU", "Australia" });
-  codes.insert({ "AT", "Austria" });
-  codes.insert({ "AZ", "Azerbaijan" });
-  codes.insert({ "BS", "Bahamas" });
-  codes.insert({ "BH", "Bahrain" });
-  codes.insert({ "BD", "Bangladesh" });
-  codes.insert({ "BB", "Barbados" });
-  codes.insert({ "BY", "Belarus" });
-  codes.insert({ "BE", "Belgium" });
-  codes.insert({ "BZ", "Belize" });
-  codes.insert({ "BJ", "Benin" });
-  codes.insert({ "BM", "Bermuda" });
-  codes.insert({ "BT", "Bhutan" });
-  codes.insert({ "BO", "Bolivia" });
-  codes.insert({ "BA", "Bosnia and Herzegovina" });
-  codes.insert({ "BW", "Botswana" });
-  codes.insert({ "BV", "Bouvet Island" });
-  codes.insert({ "BR", "Brazil" });
-  codes.insert({ "BQ", "British Antarctic Territory" });
-  codes.insert({ "IO", "British Indian Ocean Territory" });
-  codes.insert({ "VG", "British Virgin Islands" });
-  codes.insert({ "BN", "Brunei" });
-  codes.insert({ "BG", "Bulgaria" });
-  codes.insert({ "BF", "Burkina Faso" });
-  codes.insert({ "BI", "Burundi" });
-  codes.insert({ "KH", "Cambodia" });
-  codes.insert({ "CM", "Cameroon" });
-  codes.insert({ "CA", "Canada" });
-  codes.insert({ "CT", "Canton and Enderbury Islands" });
-  codes.insert({ "CV", "Cape Verde" });
-  codes.insert({ "KY", "Cayman Islands" });
-  codes.insert({ "CF", "Central African Republic" });
-  codes.insert({ "TD", "Chad" });
-  codes.insert({ "CL", "Chile" });
-  codes.insert({ "CN", "China" });
-  codes.insert({ "CX", "Christmas Island" });
-  codes.insert({ "CC", "Cocos [Keeling] Islands" });
-  codes.insert({ "CO", "Colombia" });
-  codes.insert({ "KM", "Comoros" });
-  codes.insert({ "CG", "Congo - Brazzaville" });
-  codes.insert({ "CD", "Congo - Kinshasa" });
-  codes.insert({ "CK", "Cook Islands" });
-  codes.insert({ "CR", "Costa Rica" });
-  codes.insert({ "HR", "Croatia" });
-  codes.insert({ "CU", "Cuba" });
-  codes.insert({ "CY", "Cyprus" });
-  codes.insert({ "CZ", "Czech Republic" });
-  codes.insert({ "CI", "Côte d’Ivoire" });
-  codes.insert({ "DK", "Denmark" });
-  codes.insert({ "DJ", "Djibouti" });
-  codes.insert({ "DM", "Dominica" });
-  codes.insert({ "DO", "Dominican Republic" });
-  codes.insert({ "NQ", "Dronning Maud Land" });
-  codes.insert({ "DD", "East Germany" });
-  codes.insert({ "EC", "Ecuador" });
-  codes.insert({ "EG", "Egypt" });
-  codes.insert({ "SV", "El Salvador" });
-  codes.insert({ "GQ", "Equatorial Guinea" });
-  codes.insert({ "ER", "Eritrea" });
-  codes.insert({ "EE", "Estonia" });
-  codes.insert({ "ET", "Ethiopia" });
-  codes.insert({ "FK", "Falkland Islands" });
-  codes.insert({ "FO", "Faroe Islands" });
-  codes.insert({ "FJ", "Fiji" });
-  codes.insert({ "FI", "Finland" });
-  codes.insert({ "FR", "France" });
-  codes.insert({ "GF", "French Guiana" });
-  codes.insert({ "PF", "French Polynesia" });
-  codes.insert({ "TF", "French Southern Territories" });
-  codes.insert({ "FQ", "French Southern and Antarctic Territories" });
-  codes.insert({ "GA", "Gabon" });
-  codes.insert({ "GM", "Gambia" });
-  codes.insert({ "GE", "Georgia" });
-  codes.insert({ "DE", "Germany" });
-  codes.insert({ "GH", "Ghana" });
-  codes.insert({ "GI", "Gibraltar" });
-  codes.insert({ "GR", "Greece" });
-  codes.insert({ "GL", "Greenland" });
-  codes.insert({ "GD", "Grenada" });
-  codes.insert({ "GP", "Guadeloupe" });
-  codes.insert({ "GU", "Guam" });
-  codes.insert({ "GT", "Guatemala" });
-  codes.insert({ "GG", "Guernsey" });
-  codes.insert({ "GN", "Guinea" });
-  codes.insert({ "GW", "Guinea-Bissau" });
-  codes.insert({ "GY", "Guyana" });
-  codes.insert({ "HT", "Haiti" });
-  codes.insert({ "HM", "Heard Island and McDonald Islands" });
-  codes.insert({ "HN", "Honduras" });
-  codes.insert({ "HK", "Hong Kong SAR China" });
-  codes.insert({ "HU", "Hungary" });
-  codes.insert({ "IS", "Iceland" });
-  codes.insert({ "IN", "India" });
-  codes.insert({ "ID", "Indonesia" });
-  codes.insert({ "IR", "Iran" });
-  codes.insert({ "IQ", "Iraq" });
-  codes.insert({ "IE", "Ireland" });
-  codes.insert({ "IM", "Isle of Man" });
-  codes.insert({ "IL", "Israel" });
-  codes.insert({ "IT", "Italy" });
-  codes.insert({ "JM", "Jamaica" });
-  codes.insert({ "JP", "Japan" });
-  codes.insert({ "JE", "Jersey" });
-  codes.insert({ "JT", "Johnston Island" });
-  codes.insert({ "JO", "Jordan" });
-  codes.insert({ "KZ", "Kazakhstan" });
-  codes.insert({ "KE", "Kenya" });
-  codes.insert({ "KI", "Kiribati" });
-  codes.insert({ "KW", "Kuwait" });
-  codes.insert({ "KG", "Kyrgyzstan" });
-  codes.insert({ "LA", "Laos" });
-  codes.insert({ "LV", "Latvia" });
-  codes.insert({ "LB", "Lebanon" });
-  codes.insert({ "LS", "Lesotho" });
-  codes.insert({ "LR", "Liberia" });
-  codes.insert({ "LY", "Libya" });
-  codes.insert({ "LI", "Liechtenstein" });
-  codes.insert({ "LT", "Lithuania" });
-  codes.insert({ "LU", "Luxembourg" });
-  codes.insert({ "MO", "Macau SAR China" });
-  codes.insert({ "MK", "Macedonia" });
-  codes.insert({ "MG", "Madagascar" });
-  codes.insert({ "MW", "Malawi" });
-  codes.insert({ "MY", "Malaysia" });
-  codes.insert({ "MV", "Maldives" });
-  codes.insert({ "ML", "Mali" });
-  codes.insert({ "MT", "Malta" });
-  codes.insert({ "MH", "Marshall Islands" });
-  codes.insert({ "MQ", "Martinique" });
-  codes.insert({ "MR", "Mauritania" });
-  codes.insert({ "MU", "Mauritius" });
-  codes.insert({ "YT", "Mayotte" });
-  codes.insert({ "FX", "Metropolitan France" });
-  codes.insert({ "MX", "Mexico" });
-  codes.insert({ "FM", "Micronesia" });
-  codes.insert({ "MI", "Midway Islands" });
-  codes.insert({ "MD", "Moldova" });
-  codes.insert({ "MC", "Monaco" });
-  codes.insert({ "MN", "Mongolia" });
-  codes.insert({ "ME", "Montenegro" });
-  codes.insert({ "MS", "Montserrat" });
-  codes.insert({ "MA", "Morocco" });
-  codes.insert({ "MZ", "Mozambique" });
-  codes.insert({ "MM", "Myanmar [Burma]" });
-  codes.insert({ "NA", "Namibia" });
-  codes.insert({ "NR", "Nauru" });
-  codes.insert({ "NP", "Nepal" });
-  codes.insert({ "NL", "Netherlands" });
-  codes.insert({ "AN", "Netherlands Antilles" });
-  codes.insert({ "NT", "Neutral Zone" });
-  codes.insert({ "NC", "New Caledonia" });
-  codes.insert({ "NZ", "New Zealand" });
-  codes.insert({ "NI", "Nicaragua" });
-  codes.insert({ "NE", "Niger" });
-  codes.insert({ "NG", "Nigeria" });
-  codes.insert({ "NU", "Niue" });
-  codes.insert({ "NF", "Norfolk Island" });
-  codes.insert({ "KP", "North Korea" });
-  codes.insert({ "VD", "North Vietnam" });
-  codes.insert({ "MP", "Northern Mariana Islands" });
-  codes.insert({ "NO", "Norway" });
-  codes.insert({ "OM", "Oman" });
-  codes.insert({ "PC", "Pacific Islands Trust Territory" });
-  codes.insert({ "PK", "Pakistan" });
-  codes.insert({ "PW", "Palau" });
-  codes.insert({ "PS", "Palestinian Territories" });
-  codes.insert({ "PA", "Panama" });
-  codes.insert({ "PZ", "Panama Canal Zone" });
-  codes.insert({ "PG", "Papua New Guinea" });
-  codes.insert({ "PY", "Paraguay" });
-  codes.insert({ "YD", "People's Democratic Republic of Yemen" });
-  codes.insert({ "PE", "Peru" });
-  codes.insert({ "PH", "Philippines" });
-  codes.insert({ "PN", "Pitcairn Islands" });
-  codes.insert({ "PL", "Poland" });
-  codes.insert({ "PT", "Portugal" });
-  codes.insert({ "PR", "Puerto Rico" });
-  codes.insert({ "QA", "Qatar" });
-  codes.insert({ "RO", "Romania" });
-  codes.insert({ "RU", "Russia" });
-  codes.insert({ "RW", "Rwanda" });
-  codes.insert({ "RE", "Réunion" });
-  codes.insert({ "BL", "Saint Barthélemy" });
-  codes.insert({ "SH", "Saint Helena" });
-  codes.insert({ "KN", "Saint Kitts and Nevis" });
-  codes.insert({ "LC", "Saint Lucia" });
-  codes.insert({ "MF", "Saint Martin" });
-  codes.insert({ "PM", "Saint Pierre and Miquelon" });
-  codes.insert({ "VC", "Saint Vincent and the Grenadines" });
-  codes.insert({ "WS", "Samoa" });
-  codes.insert({ "SM", "San Marino" });
-  codes.insert({ "SA", "Saudi Arabia" });
-  codes.insert({ "SN", "Senegal" });
-  codes.insert({ "RS", "Serbia" });
-  codes.insert({ "CS", "Serbia and Montenegro" });
-  codes.insert({ "SC", "Seychelles" });
-  codes.insert({ "SL", "Sierra Leone" });
-  codes.insert({ "SG", "Singapore" });
-  codes.insert({ "SK", "Slovakia" });
-  codes.insert({ "SI", "Slovenia" });
-  codes.insert({ "SB", "Solomon Islands" });
-  codes.insert({ "SO", "Somalia" });
-  codes.insert({ "ZA", "South Africa" });
-  codes.insert({ "GS", "South Georgia and the South Sandwich Islands" });
-  codes.insert({ "KR", "South Korea" });
-  codes.insert({ "ES", "Spain" });
-  codes.insert({ "LK", "Sri Lanka" });
-  codes.insert({ "SD", "Sudan" });
-  codes.insert({ "SR", "Suriname" });
-  codes.insert({ "SJ", "Svalbard and Jan Mayen" });
-  codes.insert({ "SZ", "Swaziland" });
-  codes.insert({ "SE", "Sweden" });
-  codes.insert({ "CH", "Switzerland" });
-  codes.insert({ "SY", "Syria" });
-  codes.insert({ "ST", "São Tomé and Príncipe" });
-  codes.insert({ "TW", "Taiwan" });
-  codes.insert({ "TJ", "Tajikistan" });
-  codes.insert({ "TZ", "Tanzania" });
-  codes.insert({ "TH", "Thailand" });
-  codes.insert({ "TL", "Timor-Leste" });
-  codes.insert({ "TG", "Togo" });
-  codes.insert({ "TK", "Tokelau" });
-  codes.insert({ "TO", "Tonga" });
-  codes.insert({ "TT", "Trinidad and Tobago" });
-  codes.insert({ "TN", "Tunisia" });
-  codes.insert({ "TR", "Turkey" });
-  codes.insert({ "TM", "Turkmenistan" });
-  codes.insert({ "TC", "Turks and Caicos Islands" });
-  codes.insert({ "TV", "Tuvalu" });
-  codes.insert({ "UM", "U.S. Minor Outlying Islands" });
-  codes.insert({ "PU", "U.S. Miscellaneous Pacific Islands" });
-  codes.insert({ "VI", "U.S. Virgin Islands" });
-  codes.insert({ "UG", "Uganda" });
-  codes.insert({ "UA", "Ukraine" });
-  codes.insert({ "SU", "Union of Soviet Socialist Republics" });
-  codes.insert({ "AE", "United Arab Emirates" });
-  codes.insert({ "GB", "United Kingdom" });
-  codes.insert({ "US", "United States" });
-  codes.insert({ "ZZ", "Unknown or Invalid Region" });
-  codes.insert({ "UY", "Uruguay" });
-  codes.insert({ "UZ", "Uzbekistan" });
-  codes.insert({ "VU", "Vanuatu" });
-  codes.insert({ "VA", "Vatican City" });
-  codes.insert({ "VE", "Venezuela" });
-  codes.insert({ "VN", "Vietnam" });
-  codes.insert({ "WK", "Wake Island" });
-  codes.insert({ "WF", "Wallis and Futuna" });
-  codes.insert({ "EH", "Western Sahara" });
-  codes.insert({ "YE", "Yemen" });
-  codes.insert({ "ZM", "Zambia" });
-  codes.insert({ "ZW", "Zimbabwe" });
-  codes.insert({ "AX", "Åland Islands" });
+  constexpr CountryCode country_codes[] = {
+  { "AF", "Afghanistan" },
+  { "AL", "Albania" },
+  { "DZ", "Algeria" },
+  { "AS", "American Samoa" },
+  { "AD", "Andorra" },
+  { "AO", "Angola" },
+  { "AI", "Anguilla" },
+  { "AQ", "Antarctica" },
+  { "AG", "Antigua and Barbuda" },
+  { "AR", "Argentina" },
+  { "AM", "Armenia" },
+  { "AW", "Aruba" },
+  { "AU", "Australia" },
+  { "AT", "Austria" },
+  { "AZ", "Azerbaijan" },
+  { "BS", "Bahamas" },
+  { "BH", "Bahrain" },
+  { "BD", "Bangladesh" },
+  { "BB", "Barbados" },
+  { "BY", "Belarus" },
+  { "BE", "Belgium" },
+  { "BZ", "Belize" },
+  { "BJ", "Benin" },
+  { "BM", "Bermuda" },
+  { "BT", "Bhutan" },
+  { "BO", "Bolivia" },
+  { "BA", "Bosnia and Herzegovina" },
+  { "BW", "Botswana" },
+  { "BV", "Bouvet Island" },
+  { "BR", "Brazil" },
+  { "BQ", "British Antarctic Territory" },
+  { "IO", "British Indian Ocean Territory" },
+  { "VG", "British Virgin Islands" },
+  { "BN", "Brunei" },
+  { "BG", "Bulgaria" },
+  { "BF", "Burkina Faso" },
+  { "BI", "Burundi" },
+  { "KH", "Cambodia" },
+  { "CM", "Cameroon" },
+  { "CA", "Canada" },
+  { "CT", "Canton and Enderbury Islands" },
+  { "CV", "Cape Verde" },
+  { "KY", "Cayman Islands" },
+  { "CF", "Central African Republic" },
+  { "TD", "Chad" },
+  { "CL", "Chile" },
+  { "CN", "China" },
+  { "CX", "Christmas Island" },
+  { "CC", "Cocos [Keeling] Islands" },
+  { "CO", "Colombia" },
+  { "KM", "Comoros" },
+  { "CG", "Congo - Brazzaville" },
+  { "CD", "Congo - Kinshasa" },
+  { "CK", "Cook Islands" },
+  { "CR", "Costa Rica" },
+  { "HR", "Croatia" },
+  { "CU", "Cuba" },
+  { "CY", "Cyprus" },
+  { "CZ", "Czech Republic" },
+  { "CI", "Côte d’Ivoire" },
+  { "DK", "Denmark" },
+  { "DJ", "Djibouti" },
+  { "DM", "Dominica" },
+  { "DO", "Dominican Republic" },
+  { "NQ", "Dronning Maud Land" },
+  { "DD", "East Germany" },
+  { "EC", "Ecuador" },
+  { "EG", "Egypt" },
+  { "SV", "El Salvador" },
+  { "GQ", "Equatorial Guinea" },
+  { "ER", "Eritrea" },
+  { "EE", "Estonia" },
+  { "ET", "Ethiopia" },
+  { "FK", "Falkland Islands" },
+  { "FO", "Faroe Islands" },
+  { "FJ", "Fiji" },
+  { "FI", "Finland" },
+  { "FR", "France" },
+  { "GF", "French Guiana" },
+  { "PF", "French Polynesia" },
+  { "TF", "French Southern Territories" },
+  { "FQ", "French Southern and Antarctic Territories" },
+  { "GA", "Gabon" },
+  { "GM", "Gambia" },
+  { "GE", "Georgia" },
+  { "DE", "Germany" },
+  { "GH", "Ghana" },
+  { "GI", "Gibraltar" },
+  { "GR", "Greece" },
+  { "GL", "Greenland" },
+  { "GD", "Grenada" },
+  { "GP", "Guadeloupe" },
+  { "GU", "Guam" },
+  { "GT", "Guatemala" },
+  { "GG", "Guernsey" },
+  { "GN", "Guinea" },
+  { "GW", "Guinea-Bissau" },
+  { "GY", "Guyana" },
+  { "HT", "Haiti" },
+  { "HM", "Heard Island and McDonald Islands" },
+  { "HN", "Honduras" },
+  { "HK", "Hong Kong SAR China" },
+  { "HU", "Hungary" },
+  { "IS", "Iceland" },
+  { "IN", "India" },
+  { "ID", "Indonesia" },
+  { "IR", "Iran" },
+  { "IQ", "Iraq" },
+  { "IE", "Ireland" },
+  { "IM", "Isle of Man" },
+  { "IL", "Israel" },
+  { "IT", "Italy" },
+  { "JM", "Jamaica" },
+  { "JP", "Japan" },
+  { "JE", "Jersey" },
+  { "JT", "Johnston Island" },
+  { "JO", "Jordan" },
+  { "KZ", "Kazakhstan" },
+  { "KE", "Kenya" },
+  { "KI", "Kiribati" },
+  { "KW", "Kuwait" },
+  { "KG", "Kyrgyzstan" },
+  { "LA", "Laos" },
+  { "LV", "Latvia" },
+  { "LB", "Lebanon" },
+  { "LS", "Lesotho" },
+  { "LR", "Liberia" },
+  { "LY", "Libya" },
+  { "LI", "Liechtenstein" },
+  { "LT", "Lithuania" },
+  { "LU", "Luxembourg" },
+  { "MO", "Macau SAR China" },
+  { "MK", "Macedonia" },
+  { "MG", "Madagascar" },
+  { "MW", "Malawi" },
+  { "MY", "Malaysia" },
+  { "MV", "Maldives" },
+  { "ML", "Mali" },
+  { "MT", "Malta" },
+  { "MH", "Marshall Islands" },
+  { "MQ", "Martinique" },
+  { "MR", "Mauritania" },
+  { "MU", "Mauritius" },
+  { "YT", "Mayotte" },
+  { "FX", "Metropolitan France" },
+  { "MX", "Mexico" },
+  { "FM", "Micronesia" },
+  { "MI", "Midway Islands" },
+  { "MD", "Moldova" },
+  { "MC", "Monaco" },
+  { "MN", "Mongolia" },
+  { "ME", "Montenegro" },
+  { "MS", "Montserrat" },
+  { "MA", "Morocco" },
+  { "MZ", "Mozambique" },
+  { "MM", "Myanmar [Burma]" },
+  { "NA", "Namibia" },
+  { "NR", "Nauru" },
+  { "NP", "Nepal" },
+  { "NL", "Netherlands" },
+  { "AN", "Netherlands Antilles" },
+  { "NT", "Neutral Zone" },
+  { "NC", "New Caledonia" },
+  { "NZ", "New Zealand" },
+  { "NI", "Nicaragua" },
+  { "NE", "Niger" },
+  { "NG", "Nigeria" },
+  { "NU", "Niue" },
+  { "NF", "Norfolk Island" },
+  { "KP", "North Korea" },
+  { "VD", "North Vietnam" },
+  { "MP", "Northern Mariana Islands" },
+  { "NO", "Norway" },
+  { "OM", "Oman" },
+  { "PC", "Pacific Islands Trust Territory" },
+  { "PK", "Pakistan" },
+  { "PW", "Palau" },
+  { "PS", "Palestinian Territories" },
+  { "PA", "Panama" },
+  { "PZ", "Panama Canal Zone" },
+  { "PG", "Papua New Guinea" },
+  { "PY", "Paraguay" },
+  { "YD", "People's Democratic Republic of Yemen" },
+  { "PE", "Peru" },
+  { "PH", "Philippines" },
+  { "PN", "Pitcairn Islands" },
+  { "PL", "Poland" },
+  { "PT", "Portugal" },
+  { "PR", "Puerto Rico" },
+  { "QA", "Qatar" },
+  { "RO", "Romania" },
+  { "RU", "Russia" },
+  { "RW", "Rwanda" },
+  { "RE", "Réunion" },
+  { "BL", "Saint Barthélemy" },
+  { "SH", "Saint Helena" },
+  { "KN", "Saint Kitts and Nevis" },
+  { "LC", "Saint Lucia" },
+  { "MF", "Saint Martin" },
+  { "PM", "Saint Pierre and Miquelon" },
+  { "VC", "Saint Vincent and the Grenadines" },
+  { "WS", "Samoa" },
+  { "SM", "San Marino" },
+  { "SA", "Saudi Arabia" },
+  { "SN", "Senegal" },
+  { "RS", "Serbia" },
+  { "CS", "Serbia and Montenegro" },
+  { "SC", "Seychelles" },
+  { "SL", "Sierra Leone" },
+  { "SG", "Singapore" },
+  { "SK", "Slovakia" },
+  { "SI", "Slovenia" },
+  { "SB", "Solomon Islands" },
+  { "SO", "Somalia" },
+  { "ZA", "South Africa" },
+  { "GS", "South Georgia and the South Sandwich Islands" },
+  { "KR", "South Korea" },
+  { "ES", "Spain" },
+  { "LK", "Sri Lanka" },
+  { "SD", "Sudan" },
+  { "SR", "Suriname" },
+  { "SJ", "Svalbard and Jan Mayen" },
+  { "SZ", "Swaziland" },
+  { "SE", "Sweden" },
+  { "CH", "Switzerland" },
+  { "SY", "Syria" },
+  { "ST", "São Tomé and Príncipe" },
+  { "TW", "Taiwan" },
+  { "TJ", "Tajikistan" },
+  { "TZ", "Tanzania" },
+  { "TH", "Thailand" },
+  { "TL", "Timor-Leste" },
+  { "TG", "Togo" },
+  { "TK", "Tokelau" },
+  { "TO", "Tonga" },
+  { "TT", "Trinidad and Tobago" },
+  { "TN", "Tunisia" },
+  { "TR", "Turkey" },
+  { "TM", "Turkmenistan" },
+  { "TC", "Turks and Caicos Islands" },
+  { "TV", "Tuvalu" },
+  { "UM", "U.S. Minor Outlying Islands" },
+  { "PU", "U.S. Miscellaneous Pacific Islands" },
+  { "VI", "U.S. Virgin Islands" },
+  { "UG", "Uganda" },
+  { "UA", "Ukraine" },
+  { "SU", "Union of Soviet Socialist Republics" },
+  { "AE", "United Arab Emirates" },
+  { "GB", "United Kingdom" },
+  { "US", "United States" },
+  { "ZZ", "Unknown or Invalid Region" },
+  { "UY", "Uruguay" },
+  { "UZ", "Uzbekistan" },
+  { "VU", "Vanuatu" },
+  { "VA", "Vatican City" },
+  { "VE", "Venezuela" },
+  { "VN", "Vietnam" },
+  { "WK", "Wake Island" },
+  { "WF", "Wallis and Futuna" },
+  { "EH", "Western Sahara" },
+  { "YE", "Yemen" },
+  { "ZM", "Zambia" },
+  { "ZW", "Zimbabwe" },
+  { "AX", "Åland Islands" },
+  };
 
-  StringMap countries;
-  for (auto& c : codes) {
-    countries.insert( {c.second, c.first});
+  constexpr size_t CountryCount = sizeof(country_codes) / sizeof(CountryCode);
+  constexpr uint16_t NoCountry = UINT16_MAX;
+
+  // Codes are two upper-case letters, so they index a 26x26 table directly.
+  constexpr size_t CodeSlots = 26 * 26;
+
+  constexpr size_t code_slot(std::string_view code) {
+    return code.size() == 2 &&
+      code[0] >= 'A' && code[0] <= 'Z' &&
+      code[1] >= 'A' && code[1] <= 'Z' ?
+      static_cast<size_t>(code[0] - 'A') * 26 + static_cast<size_t>(code[1] - 'A') :
+      CodeSlots;
+  }
+
+  constexpr std::array<uint16_t, CodeSlots> make_code_index() {
+    std::array<uint16_t, CodeSlots> index{};
+    for (auto& slot : index) {
+      slot = NoCountry;
+    }
+    for (size_t i = 0; i < CountryCount; ++i) {
+      index[code_slot(country_codes[i].code)] = static_cast<uint16_t>(i);
+    }
+    return index;
+  }
+
+  // Names hash into an open-addressed table at under 50% load, so a
+  // lookup is one hash and usually a single comparison.
+  constexpr size_t NameSlots = 1024;
+
+  static_assert(CountryCount < NameSlots / 2, "grow NameSlots");
+
+  // Mixes 8 bytes at a time, names are mostly 6-20 bytes.
+  constexpr size_t name_hash(std::string_view name) {
+    uint64_t hash = name.size();
+    for (size_t i = 0; i < name.size(); i += 8) {
+      uint64_t word = 0;
+      for (size_t j = i; j < name.size() && j < i + 8; ++j) {
+        word |= static_cast<uint64_t>(static_cast<uint8_t>(name[j])) << ((j - i) * 8);
+      }
+      hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+      hash ^= hash >> 29;
+    }
+    return static_cast<size_t>(hash >> 32) & (NameSlots - 1);
+  }
+
+  constexpr std::array<uint16_t, NameSlots> make_name_index() {
+    std::array<uint16_t, NameSlots> index{};
+    for (auto& slot : index) {
+      slot = NoCountry;
+    }
+    for (size_t i = 0; i < CountryCount; ++i) {
+      auto slot = name_hash(country_codes[i].name);
+      while (index[slot] != NoCountry) {
+        slot = (slot + 1) & (NameSlots - 1);
+      }
+      index[slot] = static_cast<uint16_t>(i);
+    }
+    return index;
+  }
+
+  constexpr bool valid_codes() {
+    for (size_t i = 0; i < CountryCount; ++i) {
+      if (code_slot(country_codes[i].code) == CodeSlots) return false;
+    }
+    return true;
+  }
+
+  static_assert(valid_codes(), "country codes must be two upper-case letters");
+
+  constexpr auto code_index = make_code_index();
+  constexpr auto name_index = make_name_index();
+}
+
+std::string_view country_name_for_code(std::string_view code) {
+  auto slot = code_slot(code);
+  if (slot == CodeSlots || code_index[slot] == NoCountry) {
+    return std::string_view();
+  }
+  return country_codes[code_index[slot]].name;
+}
+
+std::string_view country_code_for_name(std::string_view name) {
+  for (auto slot = name_hash(name); name_index[slot] != NoCountry;
+      slot = (slot + 1) & (NameSlots - 1)) {
+    auto& country = country_codes[name_index[slot]];
+    if (country.name == name) {
+      return country.code;
+    }
   }
-  return {codes, countries};
+  return std::string_view();
 }
@@ -1,12 +1,16 @@
-#include <unordered_map>
-#include <string>
+#ifndef COUNTRY_CODES_HPP
+#define COUNTRY_CODES_HPP
 
-typedef std::unordered_map<std::string, std::string> StringMap;
+#include <string_view>
 
-struct CountryCodeMap {
-  StringMap code_to_country;
-  StringMap country_to_code;
+struct CountryCode {
+  std::string_view code;
+  std::string_view name;
 };
 
-CountryCodeMap all_country_codes();
+// ISO 3166 code <-> country name over a compile-time table, so lookups
+// never allocate.  Both return an empty view if there's no match.
+std::string_view country_name_for_code(std::string_view code);
+std::string_view country_code_for_name(std::string_view name);
 
+#endif
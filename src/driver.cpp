@@ -4,9 +4,26 @@
 #define FUSE_USE_VERSION 26
 
 #include <fuse.h>
+#include <fuse_lowlevel.h>
 #include "cityfs.hpp"
+#include "cityfs_cache.hpp"
+#include "cityfs_radix.hpp"
+#include "cityfs_store.hpp"
+#include "cityfs_reload.hpp"
 #include "cityfs_util.hpp"
 #include "cityfs_weather.hpp"
+#ifdef CITYFS_HAVE_EMBEDDED_CITIES
+#include "cityfs_embedded.hpp"
+#endif
+#include "cityfs_inode.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <pthread.h>
+#include <semaphore.h>
+#include <set>
+#include <signal.h>
 #include <string.h>
 
 using namespace std;
@@ -14,50 +31,224 @@ using namespace cityfs;
 using namespace cityfs::util;
 
 
-static unordered_map<string, string> open_cache;
-static vector<string> country_codes;
-static CountryCodeMap country_code_map;
+// An open file's content, rendered once on open and never changed, so
+// reads copy straight out of it.  fi->fh holds a reference until the
+// file is released, so only open files cost memory.
+typedef shared_ptr<const string> Content;
 
-// Cache contents on file open. The cache works on 'real-paths'.
-static CountryMap country_map;
+static void set_content(fuse_file_info* fi, Content content) {
+  fi->fh = reinterpret_cast<uint64_t>(new Content(move(content)));
+}
+
+static const string& file_content(const fuse_file_info* fi) {
+  return **reinterpret_cast<const Content*>(fi->fh);
+}
+
+static void release_content(fuse_file_info* fi) {
+  delete reinterpret_cast<Content*>(fi->fh);
+  fi->fh = 0;
+}
+
+// Each operation works on the store current when it started, reloads
+// publish a new one without waiting for them.
+static CityStoreRef city_stores;
+static unique_ptr<Reloader> reloader;
+
+// Set with --lazy, when only the countries touched get parsed.
+static LazyCityStoreRef lazy_stores;
+static bool lazy = false;
+
+// Loading in the background, operations needing the cities wait this
+// long for them before giving up with EAGAIN.
+static chrono::milliseconds ready_timeout(1000);
+
+// How long the kernel may remember a name doesn't exist, so repeated
+// probes for .DS_Store and the like never reach us.  0 turns it off.
+static double negative_timeout = 1.0;
+
+// How long the kernel may cache entries and attributes, set with
+// --entry-timeout and --attr-timeout.  Until they're set, the high level
+// API's 1 second, or an hour with --lowlevel, which tells the kernel
+// when the cities change.
+static double entry_timeout = -1;
+static double attr_timeout = -1;
+static const double LowLevelTimeout = 3600;
+
+// Weather is fetched at most once a --weather-ttl per city name.
+static chrono::seconds weather_ttl(600);
+static unique_ptr<WeatherCache> weather_cache;
+
+// Set with --workers, the threads serving requests, 0 for one per core.
+static unsigned workers = 0;
+
+// Set with --debug, operations are traced to stderr, which FUSE's -d
+// keeps attached.  Off, workers don't queue on the stream's lock.
+static bool debug = false;
+
+// The mount's own status, /.cityfs/ready reads 1 once the cities are
+// loaded and 0 until then.
+static const string StatusDir = "/.cityfs";
+static const string ReadyPath = "/.cityfs/ready";
+static const string CachePath = "/.cityfs/cache";
+
+// There's no reloader for embedded cities, they're always loaded.
+static string ready_content() {
+  return !reloader || reloader->state() == Reloader::LoadState::Loaded ? "1\n" : "0\n";
+}
+
+// 0 once the cities are loaded, otherwise the error to fail with.
+static int wait_for_cities() {
+  if (!reloader) return 0;
+  switch (reloader->wait_loaded(ready_timeout)) {
+    case Reloader::LoadState::Loaded: return 0;
+    case Reloader::LoadState::Failed: return -EIO;
+    default: return -EAGAIN;
+  }
+}
+
+// A resolved path and the store its indexes are into.
+struct Node {
+  PathNode at;
+  CityStorePtr store;
+};
+
+// What paths resolved to with the high-level API, --path-cache entries
+// of it, null if that's 0.
+static size_t path_cache_size = 16384;
+static unique_ptr<PathCache<Node>> path_cache;
+
+// The path cache's counters, read from /.cityfs/cache.
+static string cache_content() {
+  if (!path_cache) return "";
+  auto stats = path_cache->stats();
+  return "hits " + to_string(stats.hits) + "\n" +
+    "misses " + to_string(stats.misses) + "\n" +
+    "evictions " + to_string(stats.evictions) + "\n" +
+    "size " + to_string(stats.size) + "\n";
+}
+
+// Set with --path-index, paths resolve in one walk of a radix tree over
+// the store's paths, built before the store is published.
+static bool path_index = false;
+struct IndexedStore {
+  CityStorePtr store;
+  PathIndex paths;
+};
+static shared_ptr<const IndexedStore> indexed;
+
+// Index store, patching the index of previous if changes made it from
+// that.
+static void index_paths(const CityStorePtr& previous, const CityStorePtr& store,
+    const StoreChanges* changes) {
+  auto current = atomic_load(&indexed);
+  auto paths = changes && current && current->store == previous ?
+    PathIndex(current->paths, *store, *changes) : PathIndex(*store);
+  atomic_store(&indexed, make_shared<const IndexedStore>(IndexedStore{store, move(paths)}));
+}
+
+// Null unless store is the one indexed, eg, while a reload is between
+// indexing its store and publishing it.
+static shared_ptr<const PathIndex> index_for(const CityStorePtr& store) {
+  if (!path_index) return nullptr;
+  auto current = atomic_load(&indexed);
+  if (!current || current->store != store) return nullptr;
+  return shared_ptr<const PathIndex>(current, &current->paths);
+}
+
+// Resolve path against the current cities.  Loading lazily, that's the
+// store of just path's country, parsed on first use unless path is the
+// country itself and parse_country is false, eg, as listing the root
+// stats every country.
+static Node resolve_uncached(const char* path, bool parse_country) {
+  Node node;
+  if (lazy) {
+    Tokens components(string_view(path).substr(1), '/');
+    auto component = components.begin();
+    if (component == components.end()) {
+      node.at.kind = PathNode::Root;
+      return node;
+    }
+    auto lazy_store = lazy_stores.current();
+    auto country = lazy_store->find_country(path_to_country(*component));
+    if (country == CityStore::npos) return node;
+    if (++component == components.end() && !parse_country) {
+      node.at.kind = PathNode::Country;
+      return node;
+    }
+    node.store = lazy_store->country(country);
+  } else {
+    node.store = city_stores.current();
+    if (auto paths = index_for(node.store)) {
+      node.at = paths->find(path);
+      return node;
+    }
+  }
+  node.at = resolve_path(*node.store, path);
+  return node;
+}
+
+// The generation is read before the store so a cached node is never
+// older than its tag.  A lazy country cached without its store is only
+// good for callers that don't need it parsed.
+static Node resolve(const char* path, bool parse_country = true) {
+  if (!path_cache) return resolve_uncached(path, parse_country);
+
+  auto generation = lazy ? lazy_stores.generation() : city_stores.generation();
+  Node node;
+  if (path_cache->find(path, generation, node) &&
+      (node.store || !parse_country || node.at.kind != PathNode::Country)) {
+    return node;
+  }
+  node = resolve_uncached(path, parse_country);
+  path_cache->insert(path, generation, node);
+  return node;
+}
 
 /// handle getting file attributes
 static int cityfs_getattr(const char *path, 
     struct stat *stbuf) {
 
-  cerr << "GETATTR " << path << endl;
+  if (debug) cerr << "GETATTR " << path << endl;
   memset(stbuf, 0, sizeof(struct stat));
-  string content;
-  PathMatch result;
   
   // Matched the root directory
-  if (string(path) == "/") {
+  if (strcmp(path, "/") == 0) {
     stbuf->st_mode = S_IFDIR | 0755;
     stbuf->st_nlink = 3;
     return 0;
   }
 
-  // Query the path against our city-db.
-  tie(content, result) = content_for_path(country_map, 
-      country_code_map, path, false);
-
-  // Matched a country, return a directory.
-  if (result == PathMatch::cityfs_country ) {
+  if (path == StatusDir) {
     stbuf->st_mode = S_IFDIR | 0755;
-    stbuf->st_nlink = 3;
+    stbuf->st_nlink = 2;
     return 0;
   }
-
-  // Matched a city
-  if (result == PathMatch::cityfs_city) {
+  if (path == ReadyPath || (path == CachePath && path_cache)) {
     stbuf->st_mode = S_IFREG | 0444;
     stbuf->st_nlink = 1;
-    stbuf->st_size = content.length();
+    stbuf->st_size = path == ReadyPath ? ready_content().size() : cache_content().size();
     return 0;
   }
 
-  // Nothing matched
-  return -ENOENT;
+  auto error = wait_for_cities();
+  if (error != 0) return error;
+
+  // Query the path against our city-db.
+  auto node = resolve(path, false);
+  switch (node.at.kind) {
+    case PathNode::Root:
+    case PathNode::Country:
+      stbuf->st_mode = S_IFDIR | 0755;
+      stbuf->st_nlink = 3;
+      return 0;
+    case PathNode::City:
+      stbuf->st_mode = S_IFREG | 0444;
+      stbuf->st_nlink = 1;
+      stbuf->st_size = city_content_size(*node.store, node.at.city);
+      return 0;
+    default:
+      return -ENOENT;
+  }
 }
 
 // handle opening files
@@ -65,24 +256,28 @@ static int cityfs_open(const char *cpath,
     fuse_file_info *fi) {
 
   string path = cpath;
-  cerr << "OPEN " << path << endl;
+  if (debug) cerr << "OPEN " << path << endl;
+  if ((fi->flags & O_ACCMODE) != O_RDONLY) return -EACCES;
 
-  if (!virtual_path_exists( country_map, country_code_map, path)) { 
-    return -ENOENT;
+  if (path == ReadyPath || (path == CachePath && path_cache)) {
+    set_content(fi, make_shared<const string>(
+          path == ReadyPath ? ready_content() : cache_content()));
+    return 0;
   }
 
-  std::string content;
-  PathMatch result;
-  tie(content, result) = content_for_path(
-      country_map,
-      country_code_map,
-      path, 
-      true);
-  if (result == PathMatch::cityfs_city) {
-    open_cache[path] = content;
-  }
-  
-  if ((fi->flags & O_ACCMODE) != O_RDONLY) return -EACCES;
+  auto error = wait_for_cities();
+  if (error != 0) return error;
+
+  auto node = resolve(cpath);
+  if (node.at.kind == PathNode::Missing) return -ENOENT;
+  if (node.at.kind != PathNode::City) return -EISDIR;
+  auto weather = weather_cache->weather(string(node.store->city_name(node.at.city)));
+  set_content(fi, make_shared<const string>(city_content(*node.store, node.at.city, &weather)));
+  return 0;
+}
+
+static int cityfs_release(const char* path, fuse_file_info* fi) {
+  release_content(fi);
   return 0;
 }
 
@@ -93,32 +288,65 @@ static int cityfs_readdir(const char *cpath,
                           fuse_fill_dir_t filler,
                           off_t offset,
                           fuse_file_info *fi)  {
-  string path = cpath;
-  cerr << "READDIR " << path << endl;
+  string_view path = cpath;
+  if (debug) cerr << "READDIR " << path << endl;
   
   filler(buf, ".", NULL, 0);
   filler(buf, "..", NULL, 0);
 
-  if (path == "/") {
-    for (auto code : country_codes) {
-      auto country = country_to_path(country_code_map, code);
+  if (path == StatusDir) {
+    filler(buf, ReadyPath.substr(StatusDir.size() + 1).c_str(), NULL, 0);
+    if (path_cache) filler(buf, CachePath.substr(StatusDir.size() + 1).c_str(), NULL, 0);
+    return 0;
+  }
+
+  auto error = wait_for_cities();
+  if (error != 0) return error;
+
+  auto node = resolve(cpath);
+  if (node.at.kind == PathNode::Root) {
+    filler(buf, StatusDir.substr(1).c_str(), NULL, 0);
+    if (lazy) {
+      auto lazy_store = lazy_stores.current();
+      for (size_t i = 0; i < lazy_store->country_count(); ++i) {
+        auto country = string(country_to_path(lazy_store->country_code(i)));
+        filler(buf, country.c_str(), NULL, 0);
+      }
+      return 0;
+    }
+    if (auto paths = index_for(node.store)) {
+      paths->for_each("/", [&](string_view country, const PathNode& at) {
+          if (at.kind != PathNode::Country) return true;
+          filler(buf, string(country.substr(1)).c_str(), NULL, 0);
+          return false;
+        });
+      return 0;
+    }
+    for (size_t i = 0; i < node.store->country_count(); ++i) {
+      auto country = string(country_to_path(node.store->country_code(i)));
       filler(buf, country.c_str(), NULL, 0);
     }
     return 0;
   }
-  
-  auto relative = path.substr(1);
-  auto components = split(relative, '/');
 
-  // First directory is the country
-  if (components.size() == 1) {
-    auto code = path_to_country(country_code_map, components[0]);
-    for (auto city : country_map[code].city_names) {
-      filler(buf, city_to_path(city).c_str(), NULL, 0);
+  auto paths = node.at.kind == PathNode::Country && !lazy ? index_for(node.store) : nullptr;
+  if (paths) {
+    auto directory = "/" + string(country_to_path(node.store->country_code(node.at.country))) + "/";
+    paths->for_each(directory, [&](string_view city, const PathNode&) {
+        filler(buf, city_to_path(city.substr(directory.size())).c_str(), NULL, 0);
+        return true;
+      });
+    return 0;
+  }
+  if (node.at.kind == PathNode::Country) {
+    auto& city_store = *node.store;
+    auto country = node.at.country;
+    for (auto i = city_store.city_begin(country); i < city_store.city_end(country); ++i) {
+      filler(buf, city_to_path(city_store.city_name(i)).c_str(), NULL, 0);
     }
     return 0;
   }
-  return -ENOENT;
+  return node.at.kind == PathNode::City ? -ENOTDIR : -ENOENT;
 }
 
 // handle reading a file
@@ -127,70 +355,1024 @@ static int cityfs_read(const char *path,
                        size_t size,
                        off_t offset,
                        fuse_file_info *fi)  {
-  cerr << "READ " << path << "(" << size << ")" << endl;
-  auto virtual_path = path_to_city(path); 
+  if (debug) cerr << "READ " << path << "(" << size << ")" << endl;
+
+  auto& content = file_content(fi);
+  if (offset >= static_cast<off_t>(content.size())) return 0;
 
-  auto city_iter = open_cache.find(path);
-  if (city_iter == open_cache.end()) {
-    cerr << "ERROR Reading open_cache for path " << path << endl;
-    return 0;
-  }
-  auto content = city_iter->second;
-  cout << "READ " << content.size() << "B, " << "<" << content << ">\n";
-  
-  if (offset >= content.size())  return 0;
-  
   // trim to available content
-  auto actual_size = offset + size > content.size() ? content.size() - offset :  size;
-  memcpy(buf, content.c_str() + offset, actual_size);
+  auto actual_size = min(size, content.size() - offset);
+  memcpy(buf, content.data() + offset, actual_size);
   return static_cast<int>(actual_size);
 }
 
+// Runs in the mounted daemon, after FUSE has forked.
+static void* cityfs_init(fuse_conn_info* conn) {
+  if (reloader) reloader->start();
+  return NULL;
+}
+
+static void cityfs_destroy(void* private_data) {
+  if (reloader) reloader->stop();
+}
+
+// The high level API can't invalidate kernel entries, changed cities
+// show up once their attribute and entry timeouts expire.  The low-level
+// one has the notifier drop them.
+static void log_changes(const CityStore&, const StoreChanges& changes) {
+  static const char* kinds[] = {"added", "changed", "removed"};
+  for (auto& change : changes) {
+    cerr << "CHANGED /" << country_to_path(change.country_code) << "/"
+      << city_to_path(change.name) << " " << kinds[change.kind] << endl;
+  }
+}
+
+// The low-level backend, with --lowlevel.  The kernel hands us inode
+// numbers derived from store indexes rather than paths, see
+// cityfs_inode.hpp, and entries are resolved one name at a time.
+static unique_ptr<InodeTable> inodes;
+
+// What an inode names, with the store its city indexes are into.  Lazily,
+// that's the country's own store, where the country is the only one.
+struct InodeNode {
+  inode::Kind kind = inode::Fixed;
+  InodeTable::Cities cities;
+  size_t country = 0;
+  size_t city = 0;
+  CityStorePtr store;
+
+  size_t store_country() const { return lazy ? 0 : country; }
+};
+
+// 0, or the errno to reply with.  A lazy country is only parsed if
+// parse_country, eg, to list it.
+static int find_inode(fuse_ino_t ino, InodeNode& node, bool parse_country = true) {
+  node.kind = inode::kind(ino);
+  if (node.kind == inode::Fixed) return 0;
+  if (!inodes->find(ino, node.cities)) return ESTALE;
+
+  node.country = node.cities.country(inode::country(ino));
+  node.city = node.cities.city(inode::city(ino));
+  if (lazy) {
+    if (node.country >= node.cities.lazy_store->country_count()) return ENOENT;
+    if (node.kind == inode::Country && !parse_country) return 0;
+    node.store = node.cities.lazy_store->country(node.country);
+  } else {
+    node.store = node.cities.store;
+    if (node.country >= node.store->country_count()) return ENOENT;
+  }
+  if (node.kind == inode::City && node.city >= node.store->city_count()) return ENOENT;
+  return 0;
+}
+
+static void fill_dir(struct stat& st, fuse_ino_t ino) {
+  st.st_ino = ino;
+  st.st_mode = S_IFDIR | 0755;
+  st.st_nlink = ino == inode::StatusDir ? 2 : 3;
+}
+
+static void fill_file(struct stat& st, fuse_ino_t ino, size_t size) {
+  st.st_ino = ino;
+  st.st_mode = S_IFREG | 0444;
+  st.st_nlink = 1;
+  st.st_size = size;
+}
+
+// 0 with st filled, or the errno to reply with.
+static int stat_inode(fuse_ino_t ino, struct stat& st) {
+  memset(&st, 0, sizeof(st));
+  if (ino == inode::Root || ino == inode::StatusDir) {
+    fill_dir(st, ino);
+    return 0;
+  }
+  if (ino == inode::Ready) {
+    fill_file(st, ino, ready_content().size());
+    return 0;
+  }
+
+  InodeNode node;
+  auto error = find_inode(ino, node, false);
+  if (error != 0) return error;
+  if (node.kind == inode::Country) {
+    fill_dir(st, ino);
+  } else if (node.kind == inode::City) {
+    fill_file(st, ino, city_content_size(*node.store, node.city));
+  } else {
+    return ENOENT;
+  }
+  return 0;
+}
+
+// The lookup is counted before ino is stat'ed, so the generation of the
+// cities it came from can't be pruned meanwhile.
+static void reply_entry(fuse_req_t req, fuse_ino_t ino,
+    const InodeTable::Cities& cities = InodeTable::Cities()) {
+  inodes->lookup(cities, ino);
+  fuse_entry_param entry;
+  memset(&entry, 0, sizeof(entry));
+  auto error = stat_inode(ino, entry.attr);
+  if (error != 0) {
+    inodes->forget(ino, 1);
+    fuse_reply_err(req, error);
+    return;
+  }
+  entry.ino = ino;
+  entry.attr_timeout = attr_timeout;
+  entry.entry_timeout = entry_timeout;
+  if (fuse_reply_entry(req, &entry) != 0) inodes->forget(ino, 1);
+}
+
+// A miss, cached by the kernel as a negative entry when it's allowed.
+static void reply_missing(fuse_req_t req) {
+  if (negative_timeout <= 0) {
+    fuse_reply_err(req, ENOENT);
+    return;
+  }
+  fuse_entry_param entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.entry_timeout = negative_timeout;
+  fuse_reply_entry(req, &entry);
+}
+
+// With long timeouts the kernel only forgets what it cached when told
+// to.  Its notifications can't be sent from a request handler, the
+// kernel may be waiting on the reply, so they're queued to a thread:
+// a city's pages when its weather is refreshed, the cities --watch
+// changed, and the countries under / when the cities are reloaded,
+// taking everything below with them.
+static fuse_chan* notify_channel = NULL;
+
+class Notifier {
+  public:
+    void start() {
+      _stopping = false;
+      _countries = country_names(inodes->current());
+      _thread = thread(&Notifier::run, this);
+    }
+
+    void stop() {
+      {
+        lock_guard<mutex> lock(_mutex);
+        _stopping = true;
+      }
+      _changed.notify_one();
+      if (_thread.joinable()) _thread.join();
+    }
+
+    void weather_refreshed(const string& city) {
+      {
+        lock_guard<mutex> lock(_mutex);
+        _refreshed.push_back(city);
+      }
+      _changed.notify_one();
+    }
+
+    void cities_changed(const StoreChanges& changes) {
+      {
+        lock_guard<mutex> lock(_mutex);
+        _changes.insert(_changes.end(), changes.begin(), changes.end());
+      }
+      _changed.notify_one();
+    }
+
+  private:
+    // The countries' entries under /, by name and by code, either may
+    // have been looked up.
+    struct Countries {
+      unsigned generation = 0;
+      set<string> names;
+
+      void add(string_view code) {
+        names.emplace(country_to_path(code));
+        names.emplace(code);
+      }
+    };
+
+    static Countries country_names(const InodeTable::Cities& cities) {
+      Countries countries;
+      countries.generation = cities.generation;
+      if (!cities.store && !cities.lazy_store) return countries;
+      auto count = lazy ? cities.lazy_store->country_count() : cities.store->country_count();
+      for (size_t country = 0; country < count; ++country) {
+        countries.add(lazy ? cities.lazy_store->country_code(country) :
+            cities.store->country_code(country));
+      }
+      return countries;
+    }
+
+    // Reloads are polled, a second being well inside any timeout worth
+    // notifying for.
+    void run() {
+      unique_lock<mutex> lock(_mutex);
+      while (!_stopping) {
+        _changed.wait_for(lock, chrono::seconds(1));
+        auto refreshed = move(_refreshed);
+        _refreshed.clear();
+        auto changes = move(_changes);
+        _changes.clear();
+        lock.unlock();
+        for (auto& city : refreshed) invalidate_city(city);
+        if (!changes.empty()) invalidate_changes(changes);
+        check_reload();
+        lock.lock();
+      }
+    }
+
+    // Every city by the name, in the countries parsed so far.
+    void invalidate_city(const string& name) {
+      auto cities = inodes->current();
+      if (!cities.store && !cities.lazy_store) return;
+      auto count = lazy ? cities.lazy_store->country_count() : cities.store->country_count();
+      for (size_t country = 0; country < count; ++country) {
+        auto store = lazy ? cities.lazy_store->parsed(country) : cities.store;
+        if (!store) continue;
+        auto city = store->find_city(lazy ? 0 : country, name);
+        if (city == CityStore::npos) continue;
+        auto ino = cities.city_inode(country, city);
+        fuse_lowlevel_notify_inval_inode(notify_channel, ino, 0, 0);
+      }
+    }
+
+    // A patch keeps the inodes of the cities it didn't touch.  Those
+    // updated have their attributes and pages dropped, the names of those
+    // inserted or deleted their entries, and countries that came or went
+    // theirs under /.  If a full reload has replaced it since, its
+    // countries are left for check_reload() to drop with the rest.
+    void invalidate_changes(const StoreChanges& changes) {
+      auto cities = inodes->current();
+      if (!cities.store) return;
+      if (cities.generation != _countries.generation) {
+        for (auto& change : changes) _countries.add(change.country_code);
+        return;
+      }
+      auto& city_store = *cities.store;
+      set<string> countries;
+      for (auto& change : changes) {
+        auto country = city_store.find_country(change.country_code);
+        if (country == CityStore::npos || !_countries.names.count(change.country_code)) {
+          countries.insert(change.country_code);
+          continue;
+        }
+        if (change.name.find('/') != string::npos) continue;
+
+        if (change.kind == CityChange::Updated) {
+          auto city = city_store.find_city(country, change.name);
+          if (city == CityStore::npos) continue;
+          fuse_lowlevel_notify_inval_inode(notify_channel, cities.city_inode(country, city), 0, 0);
+        } else {
+          auto name = city_to_path(change.name);
+          fuse_lowlevel_notify_inval_entry(notify_channel, cities.country_inode(country),
+              name.c_str(), name.size());
+        }
+      }
+      for (auto& code : countries) {
+        for (auto name : {string(country_to_path(code)), code}) {
+          fuse_lowlevel_notify_inval_entry(notify_channel, inode::Root, name.c_str(), name.size());
+        }
+      }
+      _countries = country_names(cities);
+    }
+
+    // Only a full reload starts a new generation, its inodes naming
+    // other cities, so every country under / is dropped.
+    void check_reload() {
+      auto cities = inodes->current();
+      if (cities.generation == _countries.generation) return;
+      for (auto& name : _countries.names) {
+        fuse_lowlevel_notify_inval_entry(notify_channel, inode::Root, name.c_str(), name.size());
+      }
+      _countries = country_names(cities);
+    }
+
+    thread _thread;
+    mutex _mutex;
+    condition_variable _changed;
+    bool _stopping = false;
+    vector<string> _refreshed;
+    StoreChanges _changes;
+    Countries _countries;
+};
+
+static Notifier notifier;
+
+// Called after each --watch patch is published.
+static void cities_changed(const CityStore& city_store, const StoreChanges& changes) {
+  log_changes(city_store, changes);
+  if (inodes) notifier.cities_changed(changes);
+}
+
+static void cityfs_ll_init(void* userdata, fuse_conn_info* conn) {
+  cityfs_init(conn);
+  notifier.start();
+}
+
+static void cityfs_ll_destroy(void* userdata) {
+  notifier.stop();
+  cityfs_destroy(userdata);
+}
+
+static void cityfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char* name) {
+  if (parent == inode::Root && name == StatusDir.substr(1)) {
+    reply_entry(req, inode::StatusDir);
+    return;
+  }
+  if (parent == inode::StatusDir) {
+    if (name == ReadyPath.substr(StatusDir.size() + 1)) {
+      reply_entry(req, inode::Ready);
+    } else {
+      reply_missing(req);
+    }
+    return;
+  }
+
+  if (parent == inode::Root) {
+    auto error = wait_for_cities();
+    if (error != 0) {
+      fuse_reply_err(req, -error);
+      return;
+    }
+    auto cities = inodes->current();
+    auto code = path_to_country(name);
+    auto country = lazy ? cities.lazy_store->find_country(code) :
+      cities.store->find_country(code);
+    if (country == CityStore::npos) {
+      reply_missing(req);
+      return;
+    }
+    reply_entry(req, cities.country_inode(country), cities);
+    return;
+  }
+
+  InodeNode node;
+  auto error = find_inode(parent, node);
+  if (error == 0 && node.kind != inode::Country) error = ENOTDIR;
+  if (error != 0) {
+    fuse_reply_err(req, error);
+    return;
+  }
+  auto city = node.store->find_city(node.store_country(), path_to_city(name));
+  if (city == CityStore::npos) {
+    reply_missing(req);
+    return;
+  }
+  reply_entry(req, node.cities.city_inode(node.country, city), node.cities);
+}
+
+static void cityfs_ll_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup) {
+  inodes->forget(ino, nlookup);
+  fuse_reply_none(req);
+}
+
+static void cityfs_ll_forget_multi(fuse_req_t req, size_t count, fuse_forget_data* forgets) {
+  for (size_t i = 0; i < count; ++i) {
+    inodes->forget(forgets[i].ino, forgets[i].nlookup);
+  }
+  fuse_reply_none(req);
+}
+
+static void cityfs_ll_getattr(fuse_req_t req, fuse_ino_t ino, fuse_file_info* fi) {
+  struct stat st;
+  auto error = stat_inode(ino, st);
+  if (error != 0) {
+    fuse_reply_err(req, error);
+    return;
+  }
+  fuse_reply_attr(req, &st, attr_timeout);
+}
+
+// Open files own their content, freed on release.
+static void cityfs_ll_open(fuse_req_t req, fuse_ino_t ino, fuse_file_info* fi) {
+  if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+    fuse_reply_err(req, EACCES);
+    return;
+  }
+
+  Content content;
+  if (ino == inode::Ready) {
+    content = make_shared<const string>(ready_content());
+  } else {
+    InodeNode node;
+    auto error = find_inode(ino, node, false);
+    if (error == 0 && node.kind != inode::City) error = EISDIR;
+    if (error != 0) {
+      fuse_reply_err(req, error);
+      return;
+    }
+    bool fetched = false;
+    auto weather = weather_cache->weather(string(node.store->city_name(node.city)), &fetched);
+    content = make_shared<const string>(city_content(*node.store, node.city, &weather));
+
+    // Pages cached by an earlier open have the same weather unless it was
+    // just fetched, the notifier drops them when it changes.
+    fi->keep_cache = !fetched;
+  }
+  set_content(fi, move(content));
+  if (fuse_reply_open(req, fi) != 0) release_content(fi);
+}
+
+static void cityfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset,
+    fuse_file_info* fi) {
+
+  auto& content = file_content(fi);
+  if (offset >= static_cast<off_t>(content.size())) {
+    fuse_reply_buf(req, NULL, 0);
+    return;
+  }
+  fuse_reply_buf(req, content.data() + offset, min(size, content.size() - offset));
+}
+
+static void cityfs_ll_release(fuse_req_t req, fuse_ino_t ino, fuse_file_info* fi) {
+  release_content(fi);
+  fuse_reply_err(req, 0);
+}
+
+// Fills a readdir reply of up to size bytes with the entries from
+// offset on, each entry's offset being the index of the next.
+class DirReply {
+  public:
+    DirReply(fuse_req_t req, size_t size, off_t offset):
+      _req(req), _buffer(size), _offset(static_cast<size_t>(offset)) {}
+
+    // The index of the next entry wanted.
+    size_t offset() const { return _offset; }
+
+    // False once the reply is full.
+    bool add(const char* name, fuse_ino_t ino, mode_t mode) {
+      struct stat st;
+      memset(&st, 0, sizeof(st));
+      st.st_ino = ino;
+      st.st_mode = mode;
+      auto size = fuse_add_direntry(_req, NULL, 0, name, NULL, 0);
+      if (_used + size > _buffer.size()) return false;
+      fuse_add_direntry(_req, _buffer.data() + _used, _buffer.size() - _used,
+          name, &st, static_cast<off_t>(++_offset));
+      _used += size;
+      return true;
+    }
+
+    void reply() {
+      fuse_reply_buf(_req, _buffer.data(), _used);
+    }
+
+  private:
+    fuse_req_t _req;
+    vector<char> _buffer;
+    size_t _used = 0;
+    size_t _offset;
+};
+
+static void cityfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset,
+    fuse_file_info* fi) {
+
+  DirReply entries(req, size, offset);
+  const char* dots[] = {".", ".."};
+  while (entries.offset() < 2 && entries.add(dots[entries.offset()], ino, S_IFDIR)) {}
+  if (entries.offset() < 2) {
+    entries.reply();
+    return;
+  }
+
+  if (ino == inode::StatusDir) {
+    if (entries.offset() == 2) {
+      entries.add(ReadyPath.substr(StatusDir.size() + 1).c_str(), inode::Ready, S_IFREG);
+    }
+    entries.reply();
+    return;
+  }
+
+  if (ino == inode::Root) {
+    auto error = wait_for_cities();
+    if (error != 0) {
+      fuse_reply_err(req, -error);
+      return;
+    }
+    if (entries.offset() == 2 &&
+        !entries.add(StatusDir.substr(1).c_str(), inode::StatusDir, S_IFDIR)) {
+      entries.reply();
+      return;
+    }
+    auto cities = inodes->current();
+    auto count = lazy ? cities.lazy_store->country_count() : cities.store->country_count();
+    for (auto country = entries.offset() - 3; country < count; ++country) {
+      auto code = lazy ? cities.lazy_store->country_code(country) :
+        cities.store->country_code(country);
+      auto name = string(country_to_path(code));
+      if (!entries.add(name.c_str(), cities.country_inode(country), S_IFDIR)) {
+        break;
+      }
+    }
+    entries.reply();
+    return;
+  }
+
+  InodeNode node;
+  auto error = find_inode(ino, node);
+  if (error == 0 && node.kind != inode::Country) error = ENOTDIR;
+  if (error != 0) {
+    fuse_reply_err(req, error);
+    return;
+  }
+  auto& city_store = *node.store;
+  auto begin = city_store.city_begin(node.store_country());
+  auto end = city_store.city_end(node.store_country());
+  for (auto city = begin + entries.offset() - 2; city < end; ++city) {
+    auto name = city_to_path(city_store.city_name(city));
+    auto child = node.cities.city_inode(node.country, city);
+    if (!entries.add(name.c_str(), child, S_IFREG)) break;
+  }
+  entries.reply();
+}
+
 struct fuse_operations cityfs_filesystem_operations;
+struct fuse_lowlevel_ops cityfs_lowlevel_operations;
+
+// Driver options, given as --name=value before the positional args.
+struct DriverOptions {
+  LoadOptions load;
+  bool compile = false;
+  bool watch = false;
+  bool lazy = false;
+  bool background = false;
+  bool lowlevel = false;
+};
+
+static bool parse_option(const string& arg, DriverOptions& options) {
+  auto eq = arg.find('=');
+  auto name = arg.substr(0, eq);
+  auto value = eq == string::npos ? string() : arg.substr(eq + 1);
+
+  if (name == "--load-threads" && !value.empty()) {
+    options.load.threads = static_cast<unsigned>(strtoul(value.c_str(), NULL, 10));
+    return true;
+  }
+  if (name == "--compile" && value.empty()) {
+    options.compile = true;
+    return true;
+  }
+  if (name == "--watch" && value.empty()) {
+    options.watch = true;
+    return true;
+  }
+  if (name == "--lazy" && value.empty()) {
+    options.lazy = true;
+    return true;
+  }
+  if (name == "--index-dir" && !value.empty()) {
+    options.load.index_dir = value;
+    return true;
+  }
+  if (name == "--lowlevel" && value.empty()) {
+    options.lowlevel = true;
+    return true;
+  }
+  if (name == "--background" && value.empty()) {
+    options.background = true;
+    return true;
+  }
+  if (name == "--ready-timeout" && !value.empty()) {
+    ready_timeout = chrono::milliseconds(strtoul(value.c_str(), NULL, 10));
+    return true;
+  }
+  if (name == "--debug" && value.empty()) {
+    debug = true;
+    return true;
+  }
+  if (name == "--workers" && !value.empty()) {
+    workers = static_cast<unsigned>(strtoul(value.c_str(), NULL, 10));
+    return true;
+  }
+  if (name == "--path-index" && value.empty()) {
+    path_index = true;
+    return true;
+  }
+  if (name == "--path-cache" && !value.empty()) {
+    path_cache_size = strtoul(value.c_str(), NULL, 10);
+    return true;
+  }
+  if (name == "--entry-timeout" && !value.empty()) {
+    entry_timeout = strtod(value.c_str(), NULL);
+    return true;
+  }
+  if (name == "--attr-timeout" && !value.empty()) {
+    attr_timeout = strtod(value.c_str(), NULL);
+    return true;
+  }
+  if (name == "--weather-ttl" && !value.empty()) {
+    weather_ttl = chrono::seconds(strtoul(value.c_str(), NULL, 10));
+    return true;
+  }
+  if (name == "--negative-timeout" && !value.empty()) {
+    negative_timeout = strtod(value.c_str(), NULL);
+    return true;
+  }
+
+  // Later options adjust the format, eg, --format=geonames --min-population=1000
+  auto& format = options.load.format;
+  if (name == "--format" && (value == "csv" || value == "geonames")) {
+    format = value == "csv" ? CityFormat() : CityFormat::geonames();
+    return true;
+  }
+  if (name == "--columns" && !value.empty()) {
+    unsigned columns[CityFormat::FieldCount];
+    size_t count = 0;
+    for (auto column : Tokens(value, ',')) {
+      if (count == CityFormat::FieldCount) return false;
+      auto last = column.data() + column.size();
+      auto result = from_chars(column.data(), last, columns[count]);
+      if (result.ec != errc() || result.ptr != last) return false;
+      ++count;
+    }
+    if (count < CityFormat::FeatureClass) return false;
+    format.columns[CityFormat::FeatureClass] = CityFormat::NoColumn;
+    copy(columns, columns + count, format.columns);
+    return true;
+  }
+  if (name == "--feature-classes" && eq != string::npos) {
+    format.feature_classes = value;
+    return true;
+  }
+  if (name == "--min-population" && !value.empty()) {
+    format.min_population = static_cast<uint32_t>(strtoul(value.c_str(), NULL, 10));
+    return true;
+  }
+  return false;
+}
+
+static void print_usage(const char* program) {
+  cout << "Usage: " << program << " [options] [city-file] [mount-point] \n\n";
+  cout << "city-file must be a csv of (country-code,city,lat,lng,elevation,region)\n\n";
+  cout << "  For example:\n";
+  cout << "    $ cityfs cities15k.csv ~/cities \n\n";
+  cout << "  Where cities15k.csv looks like:\n";
+  cout << "    AU,Gold Coast,-28.00029,153.43088,591473,Australia/Brisbane\n";
+  cout << "    AU,Gladstone,-23.84761,151.25635,30489,Australia/Brisbane\n";
+  cout << "    AU,Geelong,-38.14711,144.36069,226034,Australia/Melbourne\n\n";
+  cout << "city-file may also be a snapshot compiled with,\n";
+  cout << "    $ cityfs --compile cities15k.csv cities15k.cfsdb\n\n";
+  cout << "or a GeoNames dump, eg,\n";
+  cout << "    $ cityfs --format=geonames cities500.txt ~/cities\n\n";
+  cout << "Options:\n";
+  cout << "  --load-threads=N   parse the city file on N threads, 0 for one per core\n";
+  cout << "  --compile          write a snapshot of city-file to the second arg and exit\n";
+  cout << "  --watch            apply changed rows of city-file as soon as it's written\n";
+  cout << "  --lazy             index city-file by country and parse each on first use\n";
+  cout << "  --index-dir=DIR    keep --lazy's index of city-file in DIR rather than\n";
+  cout << "                     next to it\n";
+  cout << "  --background       mount first and load city-file after, /.cityfs/ready\n";
+  cout << "                     reads 1 once it's loaded\n";
+  cout << "  --lowlevel         serve with the low-level FUSE API, by inode\n";
+  cout << "  --ready-timeout=MS how long operations wait for a background load before\n";
+  cout << "                     failing with EAGAIN, 0 not to wait (default 1000)\n";
+  cout << "  --workers=N        threads serving requests, 0 for one per core (default)\n";
+  cout << "  --debug            trace every operation, with FUSE's debug output, in the\n";
+  cout << "                     foreground\n";
+  cout << "  --path-index       resolve and list paths with a radix tree over them\n";
+  cout << "  --path-cache=N     resolved paths to cache, /.cityfs/cache counts its\n";
+  cout << "                     hits, 0 not to (default 16384)\n";
+  cout << "  --entry-timeout=S, --attr-timeout=S\n";
+  cout << "                     seconds the kernel caches names and attributes\n";
+  cout << "                     (default 1, or 3600 with --lowlevel)\n";
+  cout << "  --weather-ttl=S    seconds a city's weather is reused (default 600)\n";
+  cout << "  --negative-timeout=S\n";
+  cout << "                     seconds the kernel caches missing names, 0 not to\n";
+  cout << "                     (default 1)\n";
+  cout << "  --format=F         city-file layout, csv (the default) or geonames\n";
+  cout << "  --columns=C,N,LAT,LNG,POP,TZ[,CLASS]\n";
+  cout << "                     zero based columns of the country code, name, latitude,\n";
+  cout << "                     longitude, population, timezone and feature class\n";
+  cout << "  --feature-classes=LIST\n";
+  cout << "                     keep rows of these feature classes, eg, P, or all if empty\n";
+  cout << "  --min-population=N keep cities of at least N people\n\n";
+  cout << "Send SIGHUP to reload city-file without unmounting.\n";
+#ifdef CITYFS_HAVE_EMBEDDED_CITIES
+  cout << "\nWithout a city-file, the cities built in from " << embedded::source
+    << " are mounted.\n";
+#endif
+}
+
+// fuse_main's steps, with a low-level session instead.
+namespace {
+  struct WorkerPool {
+    fuse_session* session;
+    fuse_chan* channel;
+    sem_t finished;
+    atomic<int> error{0};
+  };
+}
+
+// One worker, receiving and processing requests until the session exits.
+// It's only cancelled while waiting for a request, never part way
+// through one.
+static void* serve_requests(void* data) {
+  auto& pool = *static_cast<WorkerPool*>(data);
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+  auto size = fuse_chan_bufsize(pool.channel);
+  vector<char> buffer(size);
+  while (!fuse_session_exited(pool.session)) {
+    fuse_buf request;
+    memset(&request, 0, sizeof(request));
+    request.mem = buffer.data();
+    request.size = size;
+    auto channel = pool.channel;
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    auto received = fuse_session_receive_buf(pool.session, &request, &channel);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    if (received == -EINTR) continue;
+    if (received <= 0) {
+      if (received < 0) pool.error = received;
+      break;
+    }
+    fuse_session_process_buf(pool.session, &request, channel);
+  }
+  fuse_session_exit(pool.session);
+  sem_post(&pool.finished);
+  return NULL;
+}
+
+// Serve session on a fixed pool of workers, like fuse_session_loop_mt
+// but without it growing a thread for every request in flight.  The
+// workers block signals, so they land on this thread, which waits for
+// the session to exit and then cancels them.
+static int serve(fuse_session* session) {
+  auto threads = workers > 0 ? workers : max(1u, thread::hardware_concurrency());
+  if (threads == 1) return fuse_session_loop(session);
+
+  WorkerPool pool;
+  pool.session = session;
+  pool.channel = fuse_session_next_chan(session, NULL);
+  sem_init(&pool.finished, 0, 0);
+
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  vector<pthread_t> ids(threads);
+  size_t started = 0;
+  for (; started < threads; ++started) {
+    if (pthread_create(&ids[started], NULL, serve_requests, &pool) != 0) {
+      cerr << "Error starting worker thread " << started << endl;
+      break;
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  if (started == 0) fuse_session_exit(session);
+  while (!fuse_session_exited(session)) {
+    sem_wait(&pool.finished);
+  }
+  for (size_t i = 0; i < started; ++i) pthread_cancel(ids[i]);
+  for (size_t i = 0; i < started; ++i) pthread_join(ids[i], NULL);
+  sem_destroy(&pool.finished);
+  return started == 0 || pool.error < 0 ? -1 : 0;
+}
+
+static int fuse_main_lowlevel(int argc, char* argv[]) {
+  fuse_args args = FUSE_ARGS_INIT(argc, argv);
+  char* mount_point = NULL;
+  int multithreaded = 0, foreground = 0;
+  if (fuse_parse_cmdline(&args, &mount_point, &multithreaded, &foreground) != 0) {
+    return 1;
+  }
+
+  int error = 1;
+  auto channel = fuse_mount(mount_point, &args);
+  notify_channel = channel;
+  if (channel != NULL) {
+    auto session = fuse_lowlevel_new(&args, &cityfs_lowlevel_operations,
+        sizeof(cityfs_lowlevel_operations), NULL);
+    if (session != NULL) {
+      if (fuse_set_signal_handlers(session) == 0) {
+        fuse_session_add_chan(session, channel);
+        if (fuse_daemonize(foreground) == 0) {
+          error = multithreaded ? serve(session) : fuse_session_loop(session);
+        }
+        fuse_remove_signal_handlers(session);
+        fuse_session_remove_chan(channel);
+      }
+      fuse_session_destroy(session);
+    }
+    fuse_unmount(mount_point, channel);
+  }
+  free(mount_point);
+  fuse_opt_free_args(&args);
+  return error ? 1 : 0;
+}
+
+// Carry the cached paths over to store, patched from previous.  Those of
+// changed cities are dropped, and misses if any were inserted, the rest
+// are moved to the same cities in store.
+static void carry_paths(const CityStore& previous, const CityStorePtr& store,
+    const StoreChanges& changes, uint64_t generation) {
+  vector<pair<string_view, string_view>> changed;
+  bool inserted = false;
+  for (auto& change : changes) {
+    changed.emplace_back(change.country_code, change.name);
+    inserted = inserted || change.kind == CityChange::Inserted;
+  }
+  sort(changed.begin(), changed.end());
+
+  path_cache->carry(generation, [&](const string&, Node& node) {
+      auto& at = node.at;
+      node.store = store;
+      if (at.kind == PathNode::Missing) return !inserted;
+      if (at.kind == PathNode::Root) return true;
+      auto code = previous.country_code(at.country);
+      at.country = store->find_country(code);
+      if (at.country == CityStore::npos) return false;
+      if (at.kind == PathNode::Country) return true;
+      auto name = previous.city_name(at.city);
+      if (binary_search(changed.begin(), changed.end(), make_pair(code, name))) return false;
+      at.city = store->find_city(at.country, name);
+      return at.city != CityStore::npos;
+    });
+}
+
+// On the reload thread, before store replaces previous.  Cached nodes
+// hold the store they were resolved against, inodes of a patched store
+// name the same cities.
+static void prepare_publish(const CityStorePtr& previous, const CityStorePtr& store,
+    const StoreChanges* changes) {
+  if (inodes && changes) inodes->patch(previous, store);
+  if (path_index && store) index_paths(previous, store, changes);
+  if (path_cache) {
+    auto generation = (lazy ? lazy_stores.generation() : city_stores.generation()) + 1;
+    if (changes) {
+      carry_paths(*previous, store, *changes, generation);
+    } else {
+      path_cache->expire(generation);
+    }
+  }
+}
+
+static int mount(const char* program, const char* mount_point, bool lowlevel) {
+  Reloader::install_signal_handler();
+
+  // Before FUSE starts any threads, curl's global init isn't thread safe.
+  weather_init(); 
+
+  // Add flags to argv_fused for debugging, eg, "-d", "-f".
+  vector<const char*> argv_fused = {program, mount_point};
+  if (debug) argv_fused.push_back("-d");
+
+  if (entry_timeout < 0) entry_timeout = lowlevel ? LowLevelTimeout : 1.0;
+  if (attr_timeout < 0) attr_timeout = lowlevel ? LowLevelTimeout : 1.0;
+  weather_cache.reset(new WeatherCache(weather_ttl));
+
+  // The low-level backend replies with its own timeouts, the high level
+  // API takes them as options.
+  auto timeouts = "negative_timeout=" + to_string(negative_timeout) +
+    ",entry_timeout=" + to_string(entry_timeout) +
+    ",attr_timeout=" + to_string(attr_timeout);
+  if (!lowlevel) {
+    argv_fused.push_back("-o");
+    argv_fused.push_back(timeouts.c_str());
+  }
+  int argc_fused = static_cast<int>(argv_fused.size());
+  if (reloader) reloader->before_publish(prepare_publish);
+
+  if (lowlevel) {
+    weather_cache->on_refresh([](const string& city) {
+        notifier.weather_refreshed(city);
+      });
+    if (lazy) {
+      inodes.reset(new InodeTable(lazy_stores));
+    } else {
+      inodes.reset(new InodeTable(city_stores));
+    }
+    return fuse_main_lowlevel(argc_fused, (char**)argv_fused.data());
+  }
+  if (path_cache_size > 0) path_cache.reset(new PathCache<Node>(path_cache_size));
+  path_index = path_index && !lazy;
+  if (path_index && city_stores.current()) index_paths(nullptr, city_stores.current(), nullptr);
+
+  // fuse_main, with our own workers in place of fuse_loop_mt.
+  char* fuse_mount_point = NULL;
+  int multithreaded = 0;
+  auto fuse = fuse_setup(argc_fused, (char**)argv_fused.data(),
+      &cityfs_filesystem_operations, sizeof(cityfs_filesystem_operations),
+      &fuse_mount_point, &multithreaded, NULL);
+  if (fuse == NULL) return 1;
+  auto session = fuse_get_session(fuse);
+  auto error = multithreaded ? serve(session) : fuse_session_loop(session);
+  fuse_teardown(fuse, fuse_mount_point);
+  return error ? 1 : 0;
+}
 
 int main(int argc, const char * argv[]) {
 
   cityfs_filesystem_operations.getattr = cityfs_getattr;
   cityfs_filesystem_operations.open = cityfs_open;
   cityfs_filesystem_operations.read = cityfs_read;
+  cityfs_filesystem_operations.release = cityfs_release;
   cityfs_filesystem_operations.readdir = cityfs_readdir;
+  cityfs_filesystem_operations.init = cityfs_init;
+  cityfs_filesystem_operations.destroy = cityfs_destroy;
+
+  cityfs_lowlevel_operations.init = cityfs_ll_init;
+  cityfs_lowlevel_operations.destroy = cityfs_ll_destroy;
+  cityfs_lowlevel_operations.lookup = cityfs_ll_lookup;
+  cityfs_lowlevel_operations.forget = cityfs_ll_forget;
+  cityfs_lowlevel_operations.forget_multi = cityfs_ll_forget_multi;
+  cityfs_lowlevel_operations.getattr = cityfs_ll_getattr;
+  cityfs_lowlevel_operations.open = cityfs_ll_open;
+  cityfs_lowlevel_operations.read = cityfs_ll_read;
+  cityfs_lowlevel_operations.release = cityfs_ll_release;
+  cityfs_lowlevel_operations.readdir = cityfs_ll_readdir;
+
+  DriverOptions options;
+  int arg = 1;
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; ++arg) {
+    if (!parse_option(argv[arg], options)) {
+      cerr << "Unknown option " << argv[arg] << "\n\n";
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+#ifdef CITYFS_HAVE_EMBEDDED_CITIES
+  // Just a mount point mounts the built in cities, straight from the
+  // binary's pages.
+  if (argc - arg == 1 && !options.compile) {
+    auto city_store = make_shared<CityStore>();
+    if (!city_store->view(embedded::image, embedded::image_size)) {
+      cerr << "Error, the built in cities are not a cityfs image" << endl;
+      return 1;
+    }
+    cout << "Mounting " << city_store->city_count() << " cities built in from "
+      << embedded::source << "..." << endl;
+    city_stores.publish(move(city_store));
+    return mount(argv[0], argv[arg], options.lowlevel);
+  }
+#endif
 
-  if (argc < 3) {
-    cout << "Usage: " << argv[0] << " [city-file] [mount-point] \n\n";
-    cout << "city-file must be a csv of (country-code,city,lat,lng,elevation,region)\n\n";
-    cout << "  For example:\n";
-    cout << "    $ cityfs cities15k.csv ~/cities \n\n";
-    cout << "  Where cities15k.csv looks like:\n";
-    cout << "    AU,Gold Coast,-28.00029,153.43088,591473,Australia/Brisbane\n";
-    cout << "    AU,Gladstone,-23.84761,151.25635,30489,Australia/Brisbane\n";
-    cout << "    AU,Geelong,-38.14711,144.36069,226034,Australia/Melbourne\n";
+  if (argc - arg < 2) {
+    print_usage(argv[0]);
     return 1;
   } 
-  auto city_file = argv[1];
-  auto mount_point = argv[2];
+  auto city_file = argv[arg];
+  auto mount_point = argv[arg + 1];
 
-  if (!parse_cities(city_file, country_map)) return 1;
+  lazy = options.lazy && !options.compile;
+  auto background = options.background && !options.compile;
 
-  country_code_map = all_country_codes();
+  // FUSE changes to / when it daemonizes, so reloads need a full path.
+  char* city_file_path = realpath(city_file, NULL);
+  if (city_file_path == NULL) {
+    cerr << "Error reading " << city_file << endl;
+    return 1;
+  }
+  string full_path = city_file_path;
+  free(city_file_path);
 
-  index_map<Country>(country_map, country_codes);
-  
-  for (auto& country_pair : country_map) {
-    index_map<City>(country_pair.second.city_map, 
-        country_pair.second.city_names);
+  auto& index_dir = options.load.index_dir;
+  if (!index_dir.empty()) {
+    char* index_dir_path = realpath(index_dir.c_str(), NULL);
+    if (index_dir_path == NULL) {
+      cerr << "Error reading " << index_dir << endl;
+      return 1;
+    }
+    index_dir = index_dir_path;
+    free(index_dir_path);
   }
- 
-  weather_init(); 
-  
-  cout << "Mounting cityfs..." << endl;
 
-  // Add flags to argv_fused for debugging, eg, {"-d", "-f"};
-  const char* argv_fused[] = {argv[0], argv[2]};
-  int argc_fused = sizeof(argv_fused) / sizeof(char*);
+  if (lazy) {
+    if (CityStore::is_snapshot(city_file)) {
+      cerr << "Error: --lazy needs a csv city file, snapshots are mapped on demand already" << endl;
+      return 1;
+    }
+    reloader.reset(new Reloader(lazy_stores, full_path, options.load));
+    if (options.watch) reloader->watch(cities_changed);
+    if (background) {
+      reloader->load_in_background();
+    } else {
+      auto lazy_store = make_shared<LazyCityStore>();
+      LoadStats index_stats;
+      if (!lazy_store->open(full_path, options.load, &index_stats)) return 1;
+      cout << "Indexed " << city_file << ": " << lazy_store->country_count()
+        << " countries in " << index_stats.seconds * 1000.0 << "ms" << endl;
+      lazy_stores.publish(move(lazy_store));
+    }
+  } else {
+    reloader.reset(new Reloader(city_stores, full_path, options.load));
+    if (options.watch) reloader->watch(cities_changed);
+    if (background) {
+      reloader->load_in_background();
+    } else {
+      auto city_store = make_shared<CityStore>();
+      LoadStats load_stats;
+      if (!reloader->load(*city_store, &load_stats)) return 1;
+      cout << "Loaded " << city_file << ": " << load_stats << endl;
+
+      if (options.compile) {
+        auto snapshot_file = argv[arg + 1];
+        if (!city_store->save(snapshot_file)) return 1;
+        cout << "Compiled " << city_store->city_count() << " cities to " << snapshot_file << endl;
+        return 0;
+      }
+      city_stores.publish(move(city_store));
+    }
+  }
 
-  return fuse_main(argc_fused, 
-      (char**)argv_fused, 
-      &cityfs_filesystem_operations, 
-      NULL);
+  cout << "Mounting cityfs" << (background ? ", loading " + full_path + " in the background" : "")
+    << "..." << endl;
+  return mount(argv[0], mount_point, options.lowlevel);
 }
-
@@ -0,0 +1,71 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#include "mapped_file.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace cityfs {
+
+  MappedFile::~MappedFile() {
+    close();
+  }
+
+  MappedFile::MappedFile(MappedFile&& rhs) noexcept:
+    _data(rhs._data), _size(rhs._size), _open(rhs._open) {
+      rhs._data = nullptr;
+      rhs._size = 0;
+      rhs._open = false;
+    }
+
+  MappedFile& MappedFile::operator=(MappedFile&& rhs) noexcept {
+    if (this != &rhs) {
+      close();
+      _data = rhs._data;
+      _size = rhs._size;
+      _open = rhs._open;
+      rhs._data = nullptr;
+      rhs._size = 0;
+      rhs._open = false;
+    }
+    return *this;
+  }
+
+  bool MappedFile::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      return false;
+    }
+
+    // mmap rejects zero-length mappings, an empty file is still valid.
+    _size = static_cast<size_t>(st.st_size);
+    if (_size > 0) {
+      void* addr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) {
+        ::close(fd);
+        _size = 0;
+        return false;
+      }
+      madvise(addr, _size, MADV_SEQUENTIAL);
+      _data = static_cast<const char*>(addr);
+    }
+    ::close(fd);
+    _open = true;
+    return true;
+  }
+
+  void MappedFile::close() {
+    if (_data) {
+      munmap(const_cast<char*>(_data), _size);
+    }
+    _data = nullptr;
+    _size = 0;
+    _open = false;
+  }
+}
@@ -0,0 +1,38 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+
+#ifndef CITYFS_MAPPED_FILE_HPP
+#define CITYFS_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace cityfs {
+
+  // Read-only memory mapping of a whole file.  The mapping lives as
+  // long as the MappedFile, so views into data() must not outlive it.
+  class MappedFile {
+    public:
+      MappedFile() = default;
+      ~MappedFile();
+
+      MappedFile(const MappedFile&) = delete;
+      MappedFile& operator=(const MappedFile&) = delete;
+      MappedFile(MappedFile&& rhs) noexcept;
+      MappedFile& operator=(MappedFile&& rhs) noexcept;
+
+      bool open(const std::string& path);
+      void close();
+
+      bool is_open() const { return _open; }
+      const char* data() const { return _data; }
+      const char* end() const { return _data + _size; }
+      size_t size() const { return _size; }
+
+    private:
+      const char* _data = nullptr;
+      size_t _size = 0;
+      bool _open = false;
+  };
+}
+
+#endif
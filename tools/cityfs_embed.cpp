@@ -0,0 +1,98 @@
+//  Copyright (c) 2014 Daniel Grigg. All rights reserved.
+//
+// Compiles a city file into a C++ source holding its db image, for
+// building into cityfs with -DCITYFS_EMBED_CITIES=city-file.
+//
+//   $ cityfs_embed [--format=csv|geonames] cities15k.csv embedded_cities.cpp
+
+#include "src/cityfs.hpp"
+#include "src/cityfs_store.hpp"
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+using namespace cityfs;
+
+namespace {
+
+  // The image as one string literal, printable bytes as they are and the
+  // rest as three digit octal escapes, so no escape runs into the next
+  // byte.
+  void write_literal(ostream& out, const char* data, size_t size) {
+    static const size_t LineBytes = 64;
+    for (size_t i = 0; i < size; i += LineBytes) {
+      out << "  \"";
+      for (size_t j = i; j < min(size, i + LineBytes); ++j) {
+        auto c = static_cast<unsigned char>(data[j]);
+        if (c >= ' ' && c <= '~' && c != '"' && c != '\\' && c != '?') {
+          out << c;
+        } else {
+          char escape[5];
+          snprintf(escape, sizeof(escape), "\\%03o", c);
+          out << escape;
+        }
+      }
+      out << "\"\n";
+    }
+  }
+}
+
+int main(int argc, const char* argv[]) {
+  LoadOptions options;
+  int arg = 1;
+  if (arg < argc && strncmp(argv[arg], "--format=", 9) == 0) {
+    string format = argv[arg] + 9;
+    if (format != "csv" && format != "geonames") {
+      cerr << "Unknown format " << format << endl;
+      return 1;
+    }
+    options.format = format == "csv" ? CityFormat() : CityFormat::geonames();
+    ++arg;
+  }
+  if (argc - arg != 2) {
+    cerr << "Usage: " << argv[0] << " [--format=csv|geonames] [city-file] [output.cpp]" << endl;
+    return 1;
+  }
+  string city_file = argv[arg];
+  string output = argv[arg + 1];
+
+  CityStore city_store;
+  LoadStats stats;
+  if (!load_cities(city_file, city_store, options, &stats)) return 1;
+
+  // Written aside and renamed, so a failed run doesn't leave a partial
+  // source that looks up to date.
+  auto partial = output + ".tmp";
+  {
+    ofstream out(partial, ios::trunc);
+    out << "// Generated by cityfs_embed from " << city_file << ", do not edit.\n\n"
+      << "#include \"src/cityfs_embedded.hpp\"\n\n"
+      << "namespace cityfs {\n"
+      << "namespace embedded {\n\n"
+      << "// " << city_store.city_count() << " cities in "
+      << city_store.country_count() << " countries.\n"
+      << "alignas(8) const char image[] =\n";
+    write_literal(out, city_store.image(), city_store.image_size());
+    out << "  ;\n"
+      << "const size_t image_size = " << city_store.image_size() << ";\n\n"
+      << "const char source[] = \"";
+    for (auto c : city_file) {
+      if (c == '"' || c == '\\') out << '\\';
+      out << c;
+    }
+    out << "\";\n\n"
+      << "}\n"
+      << "}\n";
+    if (!out) {
+      cerr << "Error writing " << partial << endl;
+      return 1;
+    }
+  }
+  if (rename(partial.c_str(), output.c_str()) != 0) {
+    cerr << "Error writing " << output << endl;
+    return 1;
+  }
+  cout << "Embedded " << city_file << ": " << city_store.city_count() << " cities, "
+    << city_store.image_size() << " bytes" << endl;
+  return 0;
+}